@@ -0,0 +1,55 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> s_allocations{ 0 };
+
+    void* Allocate(size_t size)
+    {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        if (void* ptr = std::malloc(size ? size : 1))
+            return ptr;
+        throw std::bad_alloc();
+    }
+}
+
+uint64_t GetAllocationCount()
+{
+    return s_allocations.load(std::memory_order_relaxed);
+}
+
+//  The array and nothrow forms default to these two in the standard library, aligned ones are
+//  not used by the engine.
+void* operator new(size_t size)
+{
+    return Allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return Allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
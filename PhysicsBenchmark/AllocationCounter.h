@@ -0,0 +1,7 @@
+#pragma once
+#include <cstdint>
+
+//  Counts calls to the global operator new, which AllocationCounter.cpp replaces for the
+//  whole program. Reading the count before and after a step gives the allocations it made.
+
+uint64_t GetAllocationCount();
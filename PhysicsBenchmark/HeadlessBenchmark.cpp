@@ -0,0 +1,388 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <stdexcept>
+
+#include "PhysicsWorld.h"
+#include "Scenes.h"
+#include "Benchmark.h"
+#include "Statistics.h"
+#include "AllocationCounter.h"
+#include "PhysicsKernels.h"
+
+//  Runs the demo scenes without a window for every combination of scene, broad phase and
+//  body count, and prints per-phase timings as CSV or JSON. --help lists the options.
+//
+//  --counters 1 adds IPC and L1D, LLC and branch misses per thousand instructions of every phase,
+//  read from hardware counters where the platform allows it. With --threads above 1 they are
+//  summed over all threads, workers count their tasks towards the phase that ran them. Heap allocations per step are
+//  always reported, counted by the replaced global operator new. --sleep 0 keeps every body
+//  awake, awake_avg is the mean number of awake bodies per step. --iterations sets the velocity
+//  and position iterations of the solver. --pin 1 pins the worker threads to one core each.
+//  state_hash combines the world state hash of every step, with --deterministic 1 it matches
+//  across thread counts and broad phases.
+
+namespace
+{
+    const char USAGE[] =
+        "Usage: PhysicsBenchmark [options]\n"
+        "  --scenes 1,3,5           scenes to run, from 1 to 7\n"
+        "  --broadphases 0,2,6      broad phases to run, all by default\n"
+        "  --bodies 500,2000        body counts of the scenes that take one\n"
+        "  --steps 300              timed steps per run\n"
+        "  --warmup 20              untimed steps before them\n"
+        "  --threads 1              threads of the step, the calling one included\n"
+        "  --pin 0|1                pins the worker threads to one core each\n"
+        "  --seed 1                 seed of the scene layouts\n"
+        "  --iterations 4,1         velocity and position iterations of the solver\n"
+        "  --sleep 0|1              lets bodies at rest fall asleep\n"
+        "  --deterministic 0|1      makes state_hash match across thread counts\n"
+        "  --counters 0|1           reads hardware counters of every phase\n"
+        "  --format csv|json        output format\n"
+        "  --out file               writes the results to file instead of stdout\n"
+        "  --help                   prints this text\n";
+
+    const BenchZone PHASES[] = { BenchZone::Integrate, BenchZone::BroadPhase, BenchZone::FilterCollisions,
+                                 BenchZone::NarrowPhase, BenchZone::ResolveCollisions, BenchZone::Islands };
+    constexpr size_t PHASE_COUNT = sizeof(PHASES) / sizeof(PHASES[0]);
+
+    struct Options
+    {
+        std::vector<int> scenes = { 1, 2, 3, 5, 7 };
+        std::vector<int> broadPhases;
+        std::vector<int> bodyCounts = { 500 };
+        int steps = 300;
+        int warmup = 20;
+        int threads = 1;
+        bool pin = false;
+        bool deterministic = false;
+        uint32_t seed = DEFAULT_SCENE_SEED;
+        std::string format = "csv";
+        std::string out;
+        bool counters = false;
+        bool sleeping = true;
+        uint32_t velocityIterations = SOLVER_ITERATIONS;
+        uint32_t positionIterations = SOLVER_POSITION_ITERATIONS;
+        bool help = false;
+    };
+
+    struct RunResult
+    {
+        int scene;
+        physBroadPhase::Type broadPhase;
+        int bodyCount;
+        int steps;
+        Histogram phases[PHASE_COUNT];
+        Histogram total;
+        Histogram testCount;
+        Histogram pairCount;
+        Histogram allocations;
+        Histogram awakeCount;
+        PerfSample counters[PHASE_COUNT];
+        uint64_t stateHash = 0;
+    };
+
+    constexpr double NS_TO_MS = 1e-6;
+
+    std::string FormatHash(uint64_t hash)
+    {
+        std::ostringstream text;
+        text << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return text.str();
+    }
+
+    std::vector<int> ParseList(const std::string & text)
+    {
+        std::vector<int> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ','))
+            values.push_back(std::stoi(item));
+        return values;
+    }
+
+    //  Opens counters on the calling thread and every worker of the pool, all or none of them.
+    bool EnableCounters(physThreadPool * threadPool)
+    {
+        if (threadPool == nullptr)
+            return Benchmark::Get().EnableCounters();
+
+        std::atomic<bool> available{ true };
+        threadPool->RunOnEachThread([&](uint32_t, uint32_t)
+        {
+            if (!Benchmark::Get().EnableCounters())
+                available = false;
+        });
+        if (!available)
+            threadPool->RunOnEachThread([](uint32_t, uint32_t) { Benchmark::Get().DisableCounters(); });
+        return available;
+    }
+
+    bool ParseOptions(int argc, char** argv, Options & options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--help")
+            {
+                options.help = true;
+                return true;
+            }
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+            try
+            {
+                if (arg == "--scenes")              options.scenes = ParseList(value);
+                else if (arg == "--broadphases")    options.broadPhases = ParseList(value);
+                else if (arg == "--bodies")         options.bodyCounts = ParseList(value);
+                else if (arg == "--steps")          options.steps = std::stoi(value);
+                else if (arg == "--warmup")         options.warmup = std::stoi(value);
+                else if (arg == "--threads")        options.threads = std::stoi(value);
+                else if (arg == "--pin")            options.pin = std::stoi(value) != 0;
+                else if (arg == "--deterministic")  options.deterministic = std::stoi(value) != 0;
+                else if (arg == "--seed")           options.seed = uint32_t(std::stoul(value));
+                else if (arg == "--format")         options.format = value;
+                else if (arg == "--out")            options.out = value;
+                else if (arg == "--counters")       options.counters = std::stoi(value) != 0;
+                else if (arg == "--sleep")          options.sleeping = std::stoi(value) != 0;
+                else if (arg == "--iterations")
+                {
+                    std::vector<int> iterations = ParseList(value);
+                    if (iterations.size() != 2)
+                    {
+                        std::cerr << "--iterations takes velocity,position" << std::endl;
+                        return false;
+                    }
+                    options.velocityIterations = uint32_t(iterations[0]);
+                    options.positionIterations = uint32_t(iterations[1]);
+                }
+                else
+                {
+                    std::cerr << "Unknown option " << arg << std::endl;
+                    return false;
+                }
+            }
+            catch (const std::logic_error &)
+            {
+                //  std::stoi throws invalid_argument and out_of_range, both logic errors.
+                std::cerr << "Invalid value " << value << " for " << arg << std::endl;
+                return false;
+            }
+        }
+        for (int scene : options.scenes)
+        {
+            if (scene < 1 || scene > SCENE_COUNT)
+            {
+                std::cerr << "--scenes takes values from 1 to " << SCENE_COUNT << std::endl;
+                return false;
+            }
+        }
+        if (options.broadPhases.empty())
+            for (int i = 0; i < physBroadPhase::bpCount; ++i)
+                options.broadPhases.push_back(i);
+        for (int type : options.broadPhases)
+        {
+            if (type < 0 || type >= physBroadPhase::bpCount)
+            {
+                std::cerr << "--broadphases takes values from 0 to " << physBroadPhase::bpCount - 1 << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    RunResult Run(int scene, physBroadPhase::Type broadPhase, int bodyCount, const Options & options, physThreadPool * threadPool)
+    {
+        auto world = std::make_unique<physWorld>(broadPhase);
+        world->SetThreadPool(threadPool);
+        world->SetSleepingEnabled(options.sleeping);
+        world->SetSolverIterations(options.velocityIterations, options.positionIterations);
+        world->SetDeterministic(options.deterministic);
+        world->Reserve(bodyCount, bodyCount, bodyCount * 5);
+
+        std::vector<physBody*> bodies;
+        InitScene(scene, *world, bodies, bodyCount, options.seed);
+
+        for (int i = 0; i < options.warmup; ++i)
+            world->Simulate();
+
+        RunResult result;
+        result.scene = scene;
+        result.broadPhase = broadPhase;
+        result.bodyCount = int(bodies.size());
+        result.steps = options.steps;
+
+        uint64_t dynamicCount = 0;
+        for (auto body : bodies)
+            dynamicCount += !body->IsStatic();
+
+        auto & benchmark = Benchmark::Get();
+        benchmark.Reset();
+        for (int i = 0; i < options.steps; ++i)
+        {
+            uint64_t allocations = GetAllocationCount();
+            world->Simulate();
+            result.allocations.Add(GetAllocationCount() - allocations);
+
+            uint64_t total = 0;
+            for (size_t p = 0; p < PHASE_COUNT; ++p)
+            {
+                auto ns = benchmark.PopResult(PHASES[p]).count;
+                result.phases[p].Add(ns);
+                total += ns;
+                if (options.counters)
+                    result.counters[p] += benchmark.PopCounters(PHASES[p]);
+            }
+            result.total.Add(total);
+            result.testCount.Add(benchmark.PopValue(BenchValue::TestCount));
+            result.pairCount.Add(benchmark.PopValue(BenchValue::UniqueCollisions));
+            result.awakeCount.Add(options.sleeping ? benchmark.PopValue(BenchValue::AwakeBodies) : dynamicCount);
+            result.stateHash = (result.stateHash ^ world->ComputeStateHash()) * 1099511628211ull;
+        }
+        return result;
+    }
+
+    void WriteCsv(std::ostream & out, const std::vector<RunResult> & results, bool counters)
+    {
+        out << "scene,broadphase,bodies,steps";
+        for (auto phase : PHASES)
+            out << "," << Benchmark::GetName(phase) << "_avg_ms," << Benchmark::GetName(phase) << "_p99_ms";
+        out << ",total_avg_ms,total_min_ms,total_p50_ms,total_p90_ms,total_p99_ms,total_max_ms";
+        out << ",tests_avg,tests_p99,pairs_avg,pairs_p99,allocs_avg,allocs_max,awake_avg,state_hash";
+        if (counters)
+            for (auto phase : PHASES)
+            {
+                auto name = Benchmark::GetName(phase);
+                out << "," << name << "_ipc," << name << "_l1d_pki," << name << "_llc_pki," << name << "_branch_pki";
+            }
+        out << "\n";
+
+        for (auto & r : results)
+        {
+            out << r.scene << ",\"" << physBroadPhase::GetName(r.broadPhase) << "\"," << r.bodyCount << "," << r.steps;
+            for (auto & phase : r.phases)
+                out << "," << phase.GetMean() * NS_TO_MS << "," << phase.GetPercentile(0.99) * NS_TO_MS;
+            out << "," << r.total.GetMean() * NS_TO_MS << "," << r.total.GetMin() * NS_TO_MS
+                << "," << r.total.GetPercentile(0.5) * NS_TO_MS << "," << r.total.GetPercentile(0.9) * NS_TO_MS
+                << "," << r.total.GetPercentile(0.99) * NS_TO_MS << "," << r.total.GetMax() * NS_TO_MS;
+            out << "," << r.testCount.GetMean() << "," << r.testCount.GetPercentile(0.99)
+                << "," << r.pairCount.GetMean() << "," << r.pairCount.GetPercentile(0.99)
+                << "," << r.allocations.GetMean() << "," << r.allocations.GetMax()
+                << "," << r.awakeCount.GetMean() << "," << FormatHash(r.stateHash);
+            if (counters)
+                for (auto & c : r.counters)
+                    out << "," << c.GetIPC() << "," << c.GetPerKiloInstruction(PerfEvent::L1DMisses)
+                        << "," << c.GetPerKiloInstruction(PerfEvent::LLCMisses)
+                        << "," << c.GetPerKiloInstruction(PerfEvent::BranchMisses);
+            out << "\n";
+        }
+    }
+
+    void WriteJson(std::ostream & out, const std::vector<RunResult> & results, bool counters)
+    {
+        out << "[\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            auto & r = results[i];
+            out << "  { \"scene\": " << r.scene
+                << ", \"broadphase\": \"" << physBroadPhase::GetName(r.broadPhase) << "\""
+                << ", \"bodies\": " << r.bodyCount
+                << ", \"steps\": " << r.steps
+                << ", \"phases_avg_ms\": {";
+            for (size_t p = 0; p < PHASE_COUNT; ++p)
+                out << (p ? ", " : " ") << "\"" << Benchmark::GetName(PHASES[p]) << "\": " << r.phases[p].GetMean() * NS_TO_MS;
+            out << " }, \"phases_p99_ms\": {";
+            for (size_t p = 0; p < PHASE_COUNT; ++p)
+                out << (p ? ", " : " ") << "\"" << Benchmark::GetName(PHASES[p]) << "\": " << r.phases[p].GetPercentile(0.99) * NS_TO_MS;
+            out << " }"
+                << ", \"total_avg_ms\": " << r.total.GetMean() * NS_TO_MS
+                << ", \"total_min_ms\": " << r.total.GetMin() * NS_TO_MS
+                << ", \"total_p50_ms\": " << r.total.GetPercentile(0.5) * NS_TO_MS
+                << ", \"total_p90_ms\": " << r.total.GetPercentile(0.9) * NS_TO_MS
+                << ", \"total_p99_ms\": " << r.total.GetPercentile(0.99) * NS_TO_MS
+                << ", \"total_max_ms\": " << r.total.GetMax() * NS_TO_MS
+                << ", \"tests_avg\": " << r.testCount.GetMean()
+                << ", \"tests_p99\": " << r.testCount.GetPercentile(0.99)
+                << ", \"pairs_avg\": " << r.pairCount.GetMean()
+                << ", \"pairs_p99\": " << r.pairCount.GetPercentile(0.99)
+                << ", \"allocs_avg\": " << r.allocations.GetMean()
+                << ", \"allocs_max\": " << r.allocations.GetMax()
+                << ", \"awake_avg\": " << r.awakeCount.GetMean()
+                << ", \"state_hash\": \"" << FormatHash(r.stateHash) << "\"";
+            if (counters)
+            {
+                out << ", \"counters\": {";
+                for (size_t p = 0; p < PHASE_COUNT; ++p)
+                {
+                    auto & c = r.counters[p];
+                    out << (p ? ", " : " ") << "\"" << Benchmark::GetName(PHASES[p]) << "\": {"
+                        << " \"ipc\": " << c.GetIPC()
+                        << ", \"l1d_pki\": " << c.GetPerKiloInstruction(PerfEvent::L1DMisses)
+                        << ", \"llc_pki\": " << c.GetPerKiloInstruction(PerfEvent::LLCMisses)
+                        << ", \"branch_pki\": " << c.GetPerKiloInstruction(PerfEvent::BranchMisses) << " }";
+                }
+                out << " }";
+            }
+            out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        std::cerr << USAGE;
+        return 1;
+    }
+    if (options.help)
+    {
+        std::cout << USAGE;
+        return 0;
+    }
+
+    //  One pool for all runs, so every worker opens its counters once.
+    std::unique_ptr<physThreadPool> threadPool;
+    if (options.threads > 1)
+        threadPool = std::make_unique<physThreadPool>(uint32_t(options.threads), options.pin);
+
+    if (options.counters && !EnableCounters(threadPool.get()))
+    {
+        std::cerr << "Hardware counters are not available, continuing without them" << std::endl;
+        options.counters = false;
+    }
+
+    std::cerr << "Kernels: " << GetSimdPathName() << std::endl;
+
+    std::vector<RunResult> results;
+    for (auto scene : options.scenes)
+        for (auto bodyCount : options.bodyCounts)
+            for (auto broadPhase : options.broadPhases)
+            {
+                results.push_back(Run(scene, physBroadPhase::Type(broadPhase), bodyCount, options, threadPool.get()));
+                std::cerr << "scene " << scene << ", " << physBroadPhase::GetName(physBroadPhase::Type(broadPhase))
+                          << ", " << bodyCount << " bodies: " << results.back().total.GetMean() * NS_TO_MS << " ms/step" << std::endl;
+            }
+
+    std::ofstream file;
+    if (!options.out.empty())
+        file.open(options.out);
+    std::ostream & out = options.out.empty() ? std::cout : file;
+
+    if (options.format == "json")
+        WriteJson(out, results, options.counters);
+    else
+        WriteCsv(out, results, options.counters);
+    return 0;
+}
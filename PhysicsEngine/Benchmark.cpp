@@ -1,44 +1,164 @@
 #include "Benchmark.h"
+#include <algorithm>
 
-void Benchmark::RunTimer(const std::string & name)
+Benchmark::ThreadSlot::~ThreadSlot()
 {
-    m_startedCounters[name] = 0;
-    LARGE_INTEGER counterValue;
-    QueryPerformanceCounter(&counterValue);
-    m_startedCounters[name] = counterValue.QuadPart;
+    if (!buffer)
+        return;
+    std::lock_guard<std::mutex> lock(Benchmark::Get().m_mutex);
+    buffer->inUse = false;
+    buffer->counters.reset();
 }
 
-void Benchmark::StopTimer(const std::string & name)
+Benchmark::ThreadBuffer* Benchmark::AcquireThreadBuffer()
 {
-    LARGE_INTEGER currentCounterValue;
-    QueryPerformanceCounter(&currentCounterValue);
-    auto startedCounterEntry = m_startedCounters.find(name);
-    if (startedCounterEntry == m_startedCounters.end())
-        return;
-    auto counterDifference = currentCounterValue.QuadPart - startedCounterEntry->second;
-    m_measuredTimes[name] = Result(counterDifference);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto & buffer : m_threads)
+    {
+        if (buffer->inUse)
+            continue;
+        buffer->inUse = true;
+        buffer->depth = 0;
+        buffer->zone = BenchZone::Count;
+        return buffer.get();
+    }
+    m_threads.emplace_back(new ThreadBuffer());
+    m_threads.back()->thread = uint16_t(m_threads.size() - 1);
+    return m_threads.back().get();
+}
+
+Result Benchmark::PopResult(BenchZone zone)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    unsigned long long total = 0;
+    for (auto & buffer : m_threads)
+        total += buffer->pending[uint32_t(zone)].exchange(0, std::memory_order_relaxed);
+    return Result(total);
+}
+
+bool Benchmark::EnableCounters()
+{
+    auto & buffer = GetThreadBuffer();
+    auto counters = std::make_unique<ZoneCounters>();
+    if (!counters->counters.Open())
+        return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer.counters = std::move(counters);
+    return true;
+}
+
+void Benchmark::DisableCounters()
+{
+    auto & buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer.counters.reset();
+}
+
+bool Benchmark::HasCounters() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto & buffer : m_threads)
+        if (buffer->counters)
+            return true;
+    return false;
+}
+
+PerfSample Benchmark::PopCounters(BenchZone zone)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PerfSample total;
+    for (auto & buffer : m_threads)
+    {
+        if (!buffer->counters)
+            continue;
+        total += buffer->counters->pending[uint32_t(zone)];
+        buffer->counters->pending[uint32_t(zone)] = PerfSample();
+    }
+    return total;
+}
+
+void Benchmark::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto & buffer : m_threads)
+    {
+        for (auto & pending : buffer->pending)
+            pending.store(0, std::memory_order_relaxed);
+        buffer->written.store(0, std::memory_order_relaxed);
+        buffer->drained = 0;
+        if (buffer->counters)
+            for (auto & pending : buffer->counters->pending)
+                pending = PerfSample();
+    }
+}
+
+void Benchmark::GetEvents(std::vector<BenchEvent> & events) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    events.clear();
+    for (auto & buffer : m_threads)
+    {
+        auto written = buffer->written.load(std::memory_order_acquire);
+        auto first = written > RING_SIZE ? written - RING_SIZE : 0;
+        for (auto i = first; i < written; ++i)
+            events.push_back(buffer->events[i & (RING_SIZE - 1)]);
+    }
+    std::sort(events.begin(), events.end(), [](const BenchEvent & lhs, const BenchEvent & rhs)
+    {
+        return lhs.start < rhs.start;
+    });
 }
 
-Result Benchmark::PopResult(const std::string& name)
+uint64_t Benchmark::DrainEvents(std::vector<BenchEvent> & events)
 {
-    auto resultEntry = m_measuredTimes.find(name);
-    if (resultEntry == m_measuredTimes.end())
-        return Result();
-    auto resultValue = resultEntry->second;
-    m_measuredTimes.erase(name);
-    return resultValue;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t lost = 0;
+    for (auto & buffer : m_threads)
+    {
+        auto written = buffer->written.load(std::memory_order_acquire);
+        auto first = std::max(buffer->drained, written > RING_SIZE ? written - RING_SIZE : 0);
+        lost += first - buffer->drained;
+        for (auto i = first; i < written; ++i)
+            events.push_back(buffer->events[i & (RING_SIZE - 1)]);
+        buffer->drained = written;
+    }
+    return lost;
 }
 
-void Benchmark::RegisterValue(const std::string& name, unsigned long long value)
+const char* Benchmark::GetName(BenchZone zone)
 {
-    m_registeredValues[name] = value;
+    switch (zone)
+    {
+    case BenchZone::Total:              return "Total";
+    case BenchZone::Update:             return "Update";
+    case BenchZone::Render:             return "Render";
+    case BenchZone::Step:               return "Step";
+    case BenchZone::Integrate:          return "Integrate";
+    case BenchZone::ResetCollisions:    return "ResetCollisions";
+    case BenchZone::BroadPhase:         return "BroadPhase";
+    case BenchZone::BroadPhaseTask:     return "BroadPhaseTask";
+    case BenchZone::FilterCollisions:   return "FilterCollisions";
+    case BenchZone::NarrowPhase:        return "NarrowPhase";
+    case BenchZone::ResolveCollisions:  return "ResolveCollisions";
+    case BenchZone::SolverTask:         return "SolverTask";
+    case BenchZone::Islands:            return "Islands";
+    default:                            return "Unknown";
+    }
 }
 
-unsigned long long Benchmark::PopValue(const std::string& name)
+const char* Benchmark::GetName(BenchValue value)
 {
-    auto valueEntry = m_registeredValues.find(name);
-    if (valueEntry == m_registeredValues.end())
-        return 0;
-    auto value = valueEntry->second;
-    return value;
+    switch (value)
+    {
+    case BenchValue::TestCount:         return "TestCount";
+    case BenchValue::Size:              return "Size";
+    case BenchValue::CellSize:          return "CellSize";
+    case BenchValue::PairsAdded:        return "PairsAdded";
+    case BenchValue::PairsRemoved:      return "PairsRemoved";
+    case BenchValue::Reinserted:        return "Reinserted";
+    case BenchValue::AllCollisions:     return "AllCollisions";
+    case BenchValue::UniqueCollisions:  return "UniqueCollisions";
+    case BenchValue::AwakeBodies:       return "AwakeBodies";
+    default:                            return "Unknown";
+    }
 }
@@ -1,20 +1,56 @@
 #pragma once
-#include <unordered_map>
-#include <string>
-#include "Windows.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 
-#undef min
-#undef max
+#include "PerfCounters.h"
 
-static unsigned long long freq()
+//  Hierarchical profiler. Zones and values are enums, so recording a zone costs two clock reads
+//  and a write to a ring buffer owned by the calling thread. Build with PHYS_PROFILE=0 to compile
+//  every PHYS_PROFILE_* macro out.
+
+#ifndef PHYS_PROFILE
+#define PHYS_PROFILE 1
+#endif
+
+enum class BenchZone : uint8_t
+{
+    Total,
+    Update,
+    Render,
+    Step,
+    Integrate,
+    ResetCollisions,
+    BroadPhase,
+    BroadPhaseTask,
+    FilterCollisions,
+    NarrowPhase,
+    ResolveCollisions,
+    SolverTask,
+    Islands,
+    Count
+};
+
+enum class BenchValue : uint8_t
 {
-    LARGE_INTEGER frequency;
-    QueryPerformanceFrequency(&frequency);
-    return frequency.QuadPart;
-}
+    TestCount,
+    Size,
+    CellSize,
+    PairsAdded,
+    PairsRemoved,
+    Reinserted,
+    AllCollisions,
+    UniqueCollisions,
+    AwakeBodies,
+    Count
+};
 
 struct Result
 {
+    //  Nanoseconds.
     unsigned long long count;
 
     Result()
@@ -28,7 +64,7 @@ struct Result
 
     double micro() const
     {
-        return (count * 1000000.0) / freq();
+        return count * 0.001;
     }
 
     double milli() const
@@ -42,9 +78,85 @@ struct Result
     }
 };
 
+struct BenchEvent
+{
+    uint64_t start;
+    uint64_t end;
+    BenchZone zone;
+    uint8_t depth;
+    uint16_t thread;
+};
+
 class Benchmark
 {
+    struct ThreadBuffer;
+    struct ZoneCounters;
+
 public:
+    static constexpr uint32_t RING_SIZE = 4096;
+    static constexpr uint32_t ZONE_COUNT = uint32_t(BenchZone::Count);
+    static constexpr uint32_t VALUE_COUNT = uint32_t(BenchValue::Count);
+
+    class ScopedZone
+    {
+    public:
+        explicit ScopedZone(BenchZone zone)
+            : m_buffer(Benchmark::Get().GetThreadBuffer()), m_zone(zone), m_parent(m_buffer.zone), m_depth(m_buffer.depth++)
+        {
+            m_buffer.zone = zone;
+            if (m_buffer.counters)
+                m_buffer.counters->counters.Read(m_startCounters);
+            m_start = Now();
+        }
+        ~ScopedZone()
+        {
+            auto end = Now();
+            --m_buffer.depth;
+            m_buffer.zone = m_parent;
+            m_buffer.Record(m_zone, m_depth, m_start, end);
+            if (m_buffer.counters)
+                m_buffer.counters->Accumulate(m_zone, m_startCounters);
+        }
+        ScopedZone(const ScopedZone&) = delete;
+        void operator=(const ScopedZone&) = delete;
+
+    private:
+        ThreadBuffer & m_buffer;
+        BenchZone m_zone;
+        BenchZone m_parent;
+        uint8_t m_depth;
+        uint64_t m_start;
+        PerfSample m_startCounters;
+    };
+
+    //  Adds the counter deltas of a scope to a zone without timing it. Pool workers charge
+    //  their tasks to the zone that started the batch on another thread this way.
+    class ScopedCounters
+    {
+    public:
+        //  Counters enabled or disabled inside the scope are left alone.
+        explicit ScopedCounters(BenchZone zone)
+            : m_buffer(Benchmark::Get().GetThreadBuffer()), m_zone(zone)
+        {
+            m_counters = zone != BenchZone::Count ? m_buffer.counters.get() : nullptr;
+            if (m_counters)
+                m_counters->counters.Read(m_startCounters);
+        }
+        ~ScopedCounters()
+        {
+            if (m_counters && m_counters == m_buffer.counters.get())
+                m_counters->Accumulate(m_zone, m_startCounters);
+        }
+        ScopedCounters(const ScopedCounters&) = delete;
+        void operator=(const ScopedCounters&) = delete;
+
+    private:
+        ThreadBuffer & m_buffer;
+        ZoneCounters *m_counters;
+        BenchZone m_zone;
+        PerfSample m_startCounters;
+    };
+
     static Benchmark &Get()
     {
         static Benchmark instance;
@@ -53,16 +165,118 @@ public:
     Benchmark(Benchmark const&) = delete;
     void operator=(Benchmark const&) = delete;
 
-    void RunTimer(const std::string& name);
-    void StopTimer(const std::string& name);
-    Result PopResult(const std::string& name);
+    static uint64_t Now()
+    {
+        using namespace std::chrono;
+        return uint64_t(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+    }
 
-    void RegisterValue(const std::string &name, unsigned long long value);
-    unsigned long long PopValue(const std::string &name);
+    //  Time spent in the zone on all threads since the previous pop or Reset.
+    Result PopResult(BenchZone zone);
+
+    void RegisterValue(BenchValue value, unsigned long long amount)
+    {
+        m_values[uint32_t(value)].store(amount, std::memory_order_relaxed);
+    }
+    unsigned long long PopValue(BenchValue value) const
+    {
+        return m_values[uint32_t(value)].load(std::memory_order_relaxed);
+    }
+
+    //  Innermost zone open on the calling thread, BenchZone::Count outside of all zones.
+    BenchZone GetCurrentZone() { return GetThreadBuffer().zone; }
+
+    //  Starts hardware counters for the zones of the calling thread. Every zone then costs two
+    //  counter reads, which also land in the counts of its enclosing zones. Returns false where
+    //  counters are not available. Worker threads enable their own, see
+    //  physThreadPool::RunOnEachThread.
+    bool EnableCounters();
+    void DisableCounters();
+    bool HasCounters() const;
+
+    //  Counter deltas of the zone since the previous pop, summed over threads with counters.
+    PerfSample PopCounters(BenchZone zone);
+
+    //  Drops accumulated zone times and recorded events.
+    void Reset();
+
+    //  Copies the events still held by the ring buffers, oldest first. Call it while no zone
+    //  is being recorded, e.g. between steps.
+    void GetEvents(std::vector<BenchEvent> & events) const;
+
+    //  Appends the events recorded since the previous drain, per thread in recording order.
+    //  Events overwritten in the ring before they were drained are lost. Returns how many.
+    uint64_t DrainEvents(std::vector<BenchEvent> & events);
+
+    static const char* GetName(BenchZone zone);
+    static const char* GetName(BenchValue value);
 
 private:
+    struct ZoneCounters
+    {
+        PerfCounters counters;
+        PerfSample pending[ZONE_COUNT];
+
+        void Accumulate(BenchZone zone, const PerfSample & start)
+        {
+            PerfSample end;
+            counters.Read(end);
+            pending[uint32_t(zone)] += end - start;
+        }
+    };
+
+    struct ThreadBuffer
+    {
+        BenchEvent events[RING_SIZE];
+        std::atomic<uint64_t> written{ 0 };
+        uint64_t drained = 0;
+        std::atomic<uint64_t> pending[ZONE_COUNT] = {};
+        uint8_t depth = 0;
+        BenchZone zone = BenchZone::Count;
+        uint16_t thread = 0;
+        bool inUse = true;
+        std::unique_ptr<ZoneCounters> counters;
+
+        void Record(BenchZone zone, uint8_t eventDepth, uint64_t start, uint64_t end)
+        {
+            auto idx = written.load(std::memory_order_relaxed);
+            events[idx & (RING_SIZE - 1)] = { start, end, zone, eventDepth, thread };
+            written.store(idx + 1, std::memory_order_release);
+            pending[uint32_t(zone)].fetch_add(end - start, std::memory_order_relaxed);
+        }
+    };
+
+    //  Gives the buffer back when its thread exits, so pools that are recreated reuse buffers.
+    struct ThreadSlot
+    {
+        ThreadBuffer* buffer = nullptr;
+        ~ThreadSlot();
+    };
+
     Benchmark() {}
-    std::unordered_map<std::string, unsigned long long> m_startedCounters;
-    std::unordered_map<std::string, Result> m_measuredTimes;
-    std::unordered_map<std::string, unsigned long long> m_registeredValues;
-};
\ No newline at end of file
+
+    ThreadBuffer & GetThreadBuffer()
+    {
+        static thread_local ThreadSlot slot;
+        if (!slot.buffer)
+            slot.buffer = AcquireThreadBuffer();
+        return *slot.buffer;
+    }
+    ThreadBuffer* AcquireThreadBuffer();
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_threads;
+    std::atomic<unsigned long long> m_values[VALUE_COUNT] = {};
+};
+
+#if PHYS_PROFILE
+#define PHYS_PROFILE_CONCAT_INNER(a, b) a##b
+#define PHYS_PROFILE_CONCAT(a, b) PHYS_PROFILE_CONCAT_INNER(a, b)
+#define PHYS_PROFILE_ZONE(zone) Benchmark::ScopedZone PHYS_PROFILE_CONCAT(profileZone, __LINE__)(BenchZone::zone)
+#define PHYS_PROFILE_COUNTERS(zone) Benchmark::ScopedCounters PHYS_PROFILE_CONCAT(profileCounters, __LINE__)(zone)
+#define PHYS_PROFILE_VALUE(value, amount) Benchmark::Get().RegisterValue(BenchValue::value, amount)
+#else
+#define PHYS_PROFILE_ZONE(zone)
+#define PHYS_PROFILE_COUNTERS(zone)
+#define PHYS_PROFILE_VALUE(value, amount)
+#endif
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "PhysicsBody.h"
+#include "PhysicsCollision.h"
+#include "PhysicsBroadPhase.h"
+#include "PhysicsSettings.h"
+#include "Benchmark.h"
+
+constexpr int32_t DYNAMIC_TREE_NULL_NODE = -1;
+constexpr float DYNAMIC_TREE_AABB_MARGIN = 2.f;
+constexpr float DYNAMIC_TREE_DISPLACEMENT_MULTIPLIER = 4.f;
+
+struct TreeNode
+{
+    bool IsLeaf() const
+    {
+        return child1 == DYNAMIC_TREE_NULL_NODE;
+    }
+
+    physAABB aabb;
+    int32_t parent = DYNAMIC_TREE_NULL_NODE;    //  Next free node when not in use
+    int32_t child1 = DYNAMIC_TREE_NULL_NODE;
+    int32_t child2 = DYNAMIC_TREE_NULL_NODE;
+    int32_t height = -1;                        //  0 for leaves, -1 for free nodes
+    uint32_t bodyIdx = UINT32_MAX;
+};
+
+//  Dynamic bounding volume tree. Leaves hold fattened boxes, so a proxy has to be
+//  reinserted only when its body leaves the fat box. Tree is kept balanced with rotations.
+
+class DynamicAABBTree
+{
+public:
+    int32_t CreateProxy(const physAABB & aabb, uint32_t bodyIdx)
+    {
+        auto proxyId = AllocateNode();
+        m_nodes[proxyId].aabb = Fatten(aabb, physVec2());
+        m_nodes[proxyId].bodyIdx = bodyIdx;
+        m_nodes[proxyId].height = 0;
+        InsertLeaf(proxyId);
+        return proxyId;
+    }
+
+    void DestroyProxy(int32_t proxyId)
+    {
+        RemoveLeaf(proxyId);
+        FreeNode(proxyId);
+    }
+
+    //  Returns true if the proxy had to be reinserted.
+    bool MoveProxy(int32_t proxyId, const physAABB & aabb, const physVec2 & displacement)
+    {
+        if (m_nodes[proxyId].aabb.Contains(aabb))
+            return false;
+
+        RemoveLeaf(proxyId);
+        m_nodes[proxyId].aabb = Fatten(aabb, displacement);
+        InsertLeaf(proxyId);
+        return true;
+    }
+
+    const physAABB & GetFatAABB(int32_t proxyId) const
+    {
+        return m_nodes[proxyId].aabb;
+    }
+
+    template<typename Callback>
+    void Query(const physAABB & aabb, Callback && callback)
+    {
+        if (m_root == DYNAMIC_TREE_NULL_NODE)
+            return;
+
+        m_stack.clear();
+        m_stack.push_back(m_root);
+        while (!m_stack.empty())
+        {
+            auto & node = m_nodes[m_stack.back()];
+            m_stack.pop_back();
+
+            if (!node.aabb.Intersects(aabb))
+                continue;
+
+            if (node.IsLeaf())
+                callback(node.bodyIdx);
+            else
+            {
+                m_stack.push_back(node.child1);
+                m_stack.push_back(node.child2);
+            }
+        }
+    }
+
+    void Clear()
+    {
+        m_nodes.clear();
+        m_root = DYNAMIC_TREE_NULL_NODE;
+        m_freeList = DYNAMIC_TREE_NULL_NODE;
+    }
+
+    uint32_t GetHeight() const
+    {
+        return m_root == DYNAMIC_TREE_NULL_NODE ? 0 : m_nodes[m_root].height;
+    }
+
+    size_t GetSize() const
+    {
+        return m_nodes.size();
+    }
+
+private:
+    static physAABB Fatten(const physAABB & aabb, const physVec2 & displacement)
+    {
+        physVec2 margin(DYNAMIC_TREE_AABB_MARGIN, DYNAMIC_TREE_AABB_MARGIN);
+        physAABB fat(aabb.topLeft - margin, aabb.botRight + margin);
+
+        //  Extend in the direction of predicted motion
+        physVec2 d = displacement * DYNAMIC_TREE_DISPLACEMENT_MULTIPLIER;
+        if (d.x < 0.f) fat.topLeft.x += d.x; else fat.botRight.x += d.x;
+        if (d.y < 0.f) fat.topLeft.y += d.y; else fat.botRight.y += d.y;
+        return fat;
+    }
+
+    int32_t AllocateNode()
+    {
+        if (m_freeList == DYNAMIC_TREE_NULL_NODE)
+        {
+            m_nodes.emplace_back();
+            return int32_t(m_nodes.size() - 1);
+        }
+        auto nodeId = m_freeList;
+        m_freeList = m_nodes[nodeId].parent;
+        m_nodes[nodeId] = TreeNode();
+        return nodeId;
+    }
+
+    void FreeNode(int32_t nodeId)
+    {
+        m_nodes[nodeId].parent = m_freeList;
+        m_nodes[nodeId].height = -1;
+        m_freeList = nodeId;
+    }
+
+    void InsertLeaf(int32_t leaf)
+    {
+        if (m_root == DYNAMIC_TREE_NULL_NODE)
+        {
+            m_root = leaf;
+            m_nodes[leaf].parent = DYNAMIC_TREE_NULL_NODE;
+            return;
+        }
+
+        //  Find the best sibling using the perimeter heuristic
+        auto leafAABB = m_nodes[leaf].aabb;
+        auto index = m_root;
+        while (!m_nodes[index].IsLeaf())
+        {
+            auto & node = m_nodes[index];
+            float area = node.aabb.GetPerimeter();
+            float combinedArea = node.aabb.Combine(leafAABB).GetPerimeter();
+
+            float cost = 2.f * combinedArea;
+            float inheritanceCost = 2.f * (combinedArea - area);
+
+            auto descendCost = [&](int32_t childIdx)
+            {
+                auto & child = m_nodes[childIdx];
+                float childCost = leafAABB.Combine(child.aabb).GetPerimeter();
+                if (!child.IsLeaf())
+                    childCost -= child.aabb.GetPerimeter();
+                return childCost + inheritanceCost;
+            };
+            float cost1 = descendCost(node.child1);
+            float cost2 = descendCost(node.child2);
+
+            if (cost < cost1 && cost < cost2)
+                break;
+            index = (cost1 < cost2) ? node.child1 : node.child2;
+        }
+
+        auto sibling = index;
+        auto oldParent = m_nodes[sibling].parent;
+        auto newParent = AllocateNode();
+        m_nodes[newParent].parent = oldParent;
+        m_nodes[newParent].aabb = leafAABB.Combine(m_nodes[sibling].aabb);
+        m_nodes[newParent].height = m_nodes[sibling].height + 1;
+        m_nodes[newParent].child1 = sibling;
+        m_nodes[newParent].child2 = leaf;
+        m_nodes[sibling].parent = newParent;
+        m_nodes[leaf].parent = newParent;
+
+        if (oldParent != DYNAMIC_TREE_NULL_NODE)
+        {
+            if (m_nodes[oldParent].child1 == sibling)
+                m_nodes[oldParent].child1 = newParent;
+            else
+                m_nodes[oldParent].child2 = newParent;
+        }
+        else
+            m_root = newParent;
+
+        Refit(m_nodes[leaf].parent);
+    }
+
+    void RemoveLeaf(int32_t leaf)
+    {
+        if (leaf == m_root)
+        {
+            m_root = DYNAMIC_TREE_NULL_NODE;
+            return;
+        }
+
+        auto parent = m_nodes[leaf].parent;
+        auto grandParent = m_nodes[parent].parent;
+        auto sibling = (m_nodes[parent].child1 == leaf) ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+        if (grandParent != DYNAMIC_TREE_NULL_NODE)
+        {
+            if (m_nodes[grandParent].child1 == parent)
+                m_nodes[grandParent].child1 = sibling;
+            else
+                m_nodes[grandParent].child2 = sibling;
+            m_nodes[sibling].parent = grandParent;
+            FreeNode(parent);
+            Refit(grandParent);
+        }
+        else
+        {
+            m_root = sibling;
+            m_nodes[sibling].parent = DYNAMIC_TREE_NULL_NODE;
+            FreeNode(parent);
+        }
+    }
+
+    //  Walks up from index, rebalancing and fixing heights and boxes.
+    void Refit(int32_t index)
+    {
+        while (index != DYNAMIC_TREE_NULL_NODE)
+        {
+            index = Balance(index);
+
+            auto & node = m_nodes[index];
+            auto & child1 = m_nodes[node.child1];
+            auto & child2 = m_nodes[node.child2];
+            node.height = 1 + std::max(child1.height, child2.height);
+            node.aabb = child1.aabb.Combine(child2.aabb);
+
+            index = node.parent;
+        }
+    }
+
+    //  Performs a left or right rotation if node A is imbalanced. Returns the new subtree root.
+    int32_t Balance(int32_t iA)
+    {
+        auto & A = m_nodes[iA];
+        if (A.IsLeaf() || A.height < 2)
+            return iA;
+
+        auto iB = A.child1;
+        auto iC = A.child2;
+        auto & B = m_nodes[iB];
+        auto & C = m_nodes[iC];
+
+        int32_t balance = C.height - B.height;
+
+        //  Rotate C up
+        if (balance > 1)
+        {
+            auto iF = C.child1;
+            auto iG = C.child2;
+            auto & F = m_nodes[iF];
+            auto & G = m_nodes[iG];
+
+            C.child1 = iA;
+            C.parent = A.parent;
+            A.parent = iC;
+            ReplaceChild(C.parent, iA, iC);
+
+            if (F.height > G.height)
+            {
+                C.child2 = iF;
+                A.child2 = iG;
+                G.parent = iA;
+                A.aabb = B.aabb.Combine(G.aabb);
+                C.aabb = A.aabb.Combine(F.aabb);
+                A.height = 1 + std::max(B.height, G.height);
+                C.height = 1 + std::max(A.height, F.height);
+            }
+            else
+            {
+                C.child2 = iG;
+                A.child2 = iF;
+                F.parent = iA;
+                A.aabb = B.aabb.Combine(F.aabb);
+                C.aabb = A.aabb.Combine(G.aabb);
+                A.height = 1 + std::max(B.height, F.height);
+                C.height = 1 + std::max(A.height, G.height);
+            }
+            return iC;
+        }
+
+        //  Rotate B up
+        if (balance < -1)
+        {
+            auto iD = B.child1;
+            auto iE = B.child2;
+            auto & D = m_nodes[iD];
+            auto & E = m_nodes[iE];
+
+            B.child1 = iA;
+            B.parent = A.parent;
+            A.parent = iB;
+            ReplaceChild(B.parent, iA, iB);
+
+            if (D.height > E.height)
+            {
+                B.child2 = iD;
+                A.child1 = iE;
+                E.parent = iA;
+                A.aabb = C.aabb.Combine(E.aabb);
+                B.aabb = A.aabb.Combine(D.aabb);
+                A.height = 1 + std::max(C.height, E.height);
+                B.height = 1 + std::max(A.height, D.height);
+            }
+            else
+            {
+                B.child2 = iE;
+                A.child1 = iD;
+                D.parent = iA;
+                A.aabb = C.aabb.Combine(D.aabb);
+                B.aabb = A.aabb.Combine(E.aabb);
+                A.height = 1 + std::max(C.height, D.height);
+                B.height = 1 + std::max(A.height, E.height);
+            }
+            return iB;
+        }
+
+        return iA;
+    }
+
+    void ReplaceChild(int32_t parent, int32_t oldChild, int32_t newChild)
+    {
+        if (parent == DYNAMIC_TREE_NULL_NODE)
+        {
+            m_root = newChild;
+            return;
+        }
+        if (m_nodes[parent].child1 == oldChild)
+            m_nodes[parent].child1 = newChild;
+        else
+            m_nodes[parent].child2 = newChild;
+    }
+
+    std::vector<TreeNode> m_nodes;
+    std::vector<int32_t> m_stack;
+    int32_t m_root = DYNAMIC_TREE_NULL_NODE;
+    int32_t m_freeList = DYNAMIC_TREE_NULL_NODE;
+};
+
+//  Keeps the pairs whose fat boxes overlap between steps. Only proxies reinserted by MoveProxy
+//  change their fat box, so only they query the tree, and only pairs with one of them can stop
+//  overlapping. Static and sleeping bodies never leave their fat box and never query.
+
+class BroadPhaseDynamicTree : public physBroadPhase
+{
+public:
+    BroadPhaseDynamicTree() :
+        m_bodies(nullptr, 0) {}
+
+    void SetBodies(physBodyBufferSpan & bodies) override
+    {
+        bool rebuild = bodies.size != m_bodies.size || bodies.chunks != m_bodies.chunks;
+        m_bodies = bodies;
+        m_moved.clear();
+        if (rebuild)
+        {
+            m_tree.Clear();
+            m_pairs.Clear();
+            m_proxies.resize(m_bodies.size);
+            m_isMoved.assign(m_bodies.size, 0);
+            for (uint32_t i = 0; i < m_bodies.size; ++i)
+            {
+                m_proxies[i] = m_tree.CreateProxy(m_bodies[i].GetAABB(), i);
+                MarkMoved(i);
+            }
+            m_reinsertCount = m_bodies.size;
+            return;
+        }
+
+        for (uint32_t i = 0; i < m_bodies.size; ++i)
+        {
+            auto & body = m_bodies[i];
+            auto displacement = body.GetLinearVelocity() * m_timeStep;
+            if (m_tree.MoveProxy(m_proxies[i], body.GetAABB(), displacement))
+                MarkMoved(i);
+        }
+        m_reinsertCount = m_moved.size();
+    }
+
+    void Solve(physCollisionBuffer & collisions) override
+    {
+        unsigned long long pairsRemoved = 0;
+        unsigned long long pairsAdded = 0;
+        if (!m_moved.empty())
+        {
+            pairsRemoved = m_pairs.RemoveIf([&](uint32_t a, uint32_t b)
+            {
+                return (m_isMoved[a] || m_isMoved[b]) &&
+                       !m_tree.GetFatAABB(m_proxies[a]).Intersects(m_tree.GetFatAABB(m_proxies[b]));
+            });
+
+            for (auto bodyIdx : m_moved)
+            {
+                physAABB fatAABB = m_tree.GetFatAABB(m_proxies[bodyIdx]);
+                m_tree.Query(fatAABB, [&](uint32_t otherIdx)
+                {
+                    //  Pairs of two moved proxies are found from both sides, keep one.
+                    if (otherIdx == bodyIdx || (m_isMoved[otherIdx] && otherIdx < bodyIdx))
+                        return;
+                    pairsAdded += m_pairs.Add(bodyIdx, otherIdx);
+                });
+            }
+            for (auto bodyIdx : m_moved)
+                m_isMoved[bodyIdx] = 0;
+        }
+
+        for (auto key : m_pairs.GetPairs())
+        {
+            auto & body = m_bodies[physPairSet::GetFirst(key)];
+            auto & other = m_bodies[physPairSet::GetSecond(key)];
+            if (body.GetAABB().Intersects(other.GetAABB()))
+                collisions.AppendCollision(&body, &other);
+        }
+
+        PHYS_PROFILE_VALUE(TestCount, m_pairs.GetSize());
+        PHYS_PROFILE_VALUE(Reinserted, m_reinsertCount);
+        PHYS_PROFILE_VALUE(PairsAdded, pairsAdded);
+        PHYS_PROFILE_VALUE(PairsRemoved, pairsRemoved);
+        PHYS_PROFILE_VALUE(Size, m_tree.GetSize());
+    }
+
+private:
+    void MarkMoved(uint32_t bodyIdx)
+    {
+        m_isMoved[bodyIdx] = 1;
+        m_moved.push_back(bodyIdx);
+    }
+
+    physBodyBufferSpan m_bodies;
+    DynamicAABBTree m_tree;
+    std::vector<int32_t> m_proxies;
+    //  Bodies reinserted this step, and a flag per body for the same.
+    std::vector<uint32_t> m_moved;
+    std::vector<uint8_t> m_isMoved;
+    physPairSet m_pairs;
+    unsigned long long m_reinsertCount = 0;
+};
@@ -2,7 +2,9 @@
 #include "PhysicsBody.h"
 #include <vector>
 #include <algorithm>
+#include <cstring>
 #include "PhysicsCollision.h"
+#include "PhysicsBroadPhase.h"
 
 constexpr uint8_t   HIERARCHICAL_GRID_LEVELS = 4;
 constexpr uint16_t  HIERARCHICAL_GRID_NUM_OF_BUCKETS = 4001;
@@ -172,12 +174,11 @@ private:
     unsigned long long m_collisionCount = 0;
 }; 
 
-class BroadPhaseHierarchicalGrid
+class BroadPhaseHierarchicalGrid : public physBroadPhase
 {
 public:
     BroadPhaseHierarchicalGrid() : m_bodiesCount(0)
     {
-        m_wrappedBodies.resize(MAX_BODIES);
     }
 
     ~BroadPhaseHierarchicalGrid()
@@ -185,9 +186,11 @@ public:
 
     }
 
-    void SetBodies(physBodyBufferSpan & bodies)
+    void SetBodies(physBodyBufferSpan & bodies) override
     {
         m_bodiesCount = bodies.size;
+        if (m_wrappedBodies.size() < m_bodiesCount)
+            m_wrappedBodies.resize(m_bodiesCount);
         for(uint32_t i = 0; i < m_bodiesCount; ++i)
         {
             m_wrappedBodies[i] = GridObject(&bodies[i]);
@@ -195,13 +198,13 @@ public:
         }
     }
 
-    void Solve(physCollisionBuffer & collisions)
+    void Solve(physCollisionBuffer & collisions) override
     {
         for(uint32_t i = 0; i < m_bodiesCount; ++i)
         {
             m_hg.SolveForObject(m_wrappedBodies[i], collisions);
         }
-        Benchmark::Get().RegisterValue("TestCount", m_hg.GetCollisionCount());
+        PHYS_PROFILE_VALUE(TestCount, m_hg.GetCollisionCount());
         m_hg.Clear();
     }
 private:
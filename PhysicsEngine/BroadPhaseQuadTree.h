@@ -2,6 +2,7 @@
 
 #include "PhysicsBody.h"
 #include "PhysicsCollision.h"
+#include "PhysicsBroadPhase.h"
 #include <vector>
 
 template<uint32_t N>
@@ -23,7 +24,7 @@ struct Node
 
 //  TREE WINDING: NW -> SW -> SE -> NE
 
-class BroadPhaseQuadTree
+class BroadPhaseQuadTree : public physBroadPhase
 {
 public:
     BroadPhaseQuadTree(physVec2 treeCenter, float treeHalfWidth) :
@@ -34,15 +35,30 @@ public:
         m_testCount = 0;
     }
 
-    void SetBodies(physBodyBufferSpan & bodies)
+    void SetBodies(physBodyBufferSpan & bodies) override
     {
         for(uint32_t i = 0; i < bodies.size; ++i)
             InsertObject(&bodies[i], m_treeArray);
     }
 
-    void Solve(physCollisionBuffer & collisions)
+    void Solve(physCollisionBuffer & collisions) override
     {
-        SolveCollisions(collisions);
+        //  Nodes only test against themselves and their ancestors, so they can be split
+        //  into independent ranges of the node array.
+        if (m_threadPool != nullptr)
+        {
+            m_testCount += SolveParallel(BROAD_PHASE_TASK_COUNT, collisions, [this](uint32_t taskIdx, physPairList & pairs)
+            {
+                uint64_t testCount = 0;
+                uint32_t first = QUAD_TREE_NODES * taskIdx / BROAD_PHASE_TASK_COUNT;
+                uint32_t last = QUAD_TREE_NODES * (taskIdx + 1) / BROAD_PHASE_TASK_COUNT;
+                for (uint32_t i = first; i < last; ++i)
+                    testCount += SolveNode(pairs, i);
+                return testCount;
+            });
+        }
+        else
+            SolveCollisions(collisions);
         Clear();
     }
 
@@ -96,6 +112,21 @@ private:
 
     void SolveCollisions(physCollisionBuffer & collisions, uint32_t nodeIdx = 0)
     {
+        m_testCount += SolveNode(collisions, nodeIdx);
+
+        for (uint32_t i = (nodeIdx * 4) + 1; i <= (nodeIdx + 1) * 4; ++i)
+        {
+            if (i >= QUAD_TREE_NODES)
+                break;
+            SolveCollisions(collisions, i);
+        }
+    }
+
+    //  Tests bodies of the node against the node itself and all of its ancestors.
+    template<typename Output>
+    uint64_t SolveNode(Output & output, uint32_t nodeIdx) const
+    {
+        uint64_t testCount = 0;
         auto & currentNode = m_treeArray[nodeIdx];
         uint32_t otherNodeIdx = nodeIdx;
         while(true)
@@ -110,27 +141,21 @@ private:
                     auto &aabb1 = bodyA->GetAABB();
                     auto &aabb2 = bodyB->GetAABB();
                     if (aabb1.Intersects(aabb2))
-                        collisions.AppendCollision(bodyA, bodyB);
-                    ++m_testCount;
+                        output.AppendCollision(bodyA, bodyB);
+                    ++testCount;
                 }
             }
             int32_t breakFlag = int32_t(otherNodeIdx) - 1;
             if (breakFlag < 0) break;
             otherNodeIdx = (otherNodeIdx - 1) / 4;
         }
-
-        for (uint32_t i = (nodeIdx * 4) + 1; i <= (nodeIdx + 1) * 4; ++i)
-        {
-            if (i >= QUAD_TREE_NODES)
-                break;
-            SolveCollisions(collisions, i);
-        }
+        return testCount;
     }
 
     void Clear()
     {
-        Benchmark::Get().RegisterValue("TestCount", m_testCount);
-        //Benchmark::Get().RegisterValue("Size", GetSize());
+        PHYS_PROFILE_VALUE(TestCount, m_testCount);
+        //PHYS_PROFILE_VALUE(Size, GetSize());
         m_testCount = 0;
         for (uint32_t i = 0; i < QUAD_TREE_NODES; ++i)
             m_treeArray[i].bodies.clear();
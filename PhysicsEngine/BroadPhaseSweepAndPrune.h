@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "PhysicsBody.h"
+#include "PhysicsCollision.h"
+#include "PhysicsBroadPhase.h"
+#include "Benchmark.h"
+
+struct SapEndpoint
+{
+    SapEndpoint() : value(0.f), data(0) {}
+    SapEndpoint(float value, uint32_t bodyIdx, bool isMax) :
+        value(value),
+        data((bodyIdx << 1) | uint32_t(isMax)) {}
+
+    uint32_t GetBody() const { return data >> 1; }
+    bool IsMin() const { return (data & 1) == 0; }
+
+    //  On equal values min endpoints go first, so touching boxes count as overlapping
+    //  just like in physAABB::Intersects.
+    bool operator<(const SapEndpoint & rhs) const
+    {
+        return value < rhs.value || (value == rhs.value && IsMin() && !rhs.IsMin());
+    }
+
+    float value;
+    uint32_t data;
+};
+
+//  Incremental sweep and prune. Endpoint lists of both axes are kept sorted between steps
+//  and repaired with insertion sort. Every swap of a min and a max endpoint means a pair
+//  starts or stops overlapping on that axis, so the pair set is only touched there.
+
+class BroadPhaseSweepAndPrune : public physBroadPhase
+{
+public:
+    BroadPhaseSweepAndPrune() :
+        m_bodies(nullptr, 0) {}
+
+    void SetBodies(physBodyBufferSpan & bodies) override
+    {
+        bool rebuild = bodies.size != m_bodies.size || bodies.chunks != m_bodies.chunks;
+        m_bodies = bodies;
+        if (rebuild)
+            Rebuild();
+        else
+            Update();
+    }
+
+    void Solve(physCollisionBuffer & collisions) override
+    {
+        for (auto key : m_pairs.GetPairs())
+            collisions.AppendCollision(&m_bodies[physPairSet::GetFirst(key)], &m_bodies[physPairSet::GetSecond(key)]);
+
+        PHYS_PROFILE_VALUE(TestCount, m_testCount);
+        PHYS_PROFILE_VALUE(PairsAdded, m_pairsAdded);
+        PHYS_PROFILE_VALUE(PairsRemoved, m_pairsRemoved);
+        PHYS_PROFILE_VALUE(Size, m_pairs.GetSize());
+        m_testCount = 0;
+        m_pairsAdded = 0;
+        m_pairsRemoved = 0;
+    }
+
+private:
+    void Rebuild()
+    {
+        m_pairs.Clear();
+
+        for (uint8_t axis = 0; axis < 2; ++axis)
+        {
+            auto & endpoints = m_endpoints[axis];
+            endpoints.resize(m_bodies.size * 2);
+            for (uint32_t i = 0; i < m_bodies.size; ++i)
+            {
+                auto & aabb = m_bodies[i].GetAABB();
+                endpoints[i * 2] = SapEndpoint(GetAxis(aabb.topLeft, axis), i, false);
+                endpoints[i * 2 + 1] = SapEndpoint(GetAxis(aabb.botRight, axis), i, true);
+            }
+            std::sort(endpoints.begin(), endpoints.end());
+        }
+
+        //  Initial pairs come from a single sweep over the x axis.
+        std::vector<uint32_t> active;
+        for (auto & endpoint : m_endpoints[0])
+        {
+            auto bodyIdx = endpoint.GetBody();
+            if (endpoint.IsMin())
+            {
+                for (auto otherIdx : active)
+                    if (Overlaps(bodyIdx, otherIdx))
+                        AddPair(bodyIdx, otherIdx);
+                active.push_back(bodyIdx);
+            }
+            else
+                active.erase(std::find(active.begin(), active.end(), bodyIdx));
+        }
+    }
+
+    void Update()
+    {
+        for (uint8_t axis = 0; axis < 2; ++axis)
+        {
+            for (auto & endpoint : m_endpoints[axis])
+            {
+                auto & aabb = m_bodies[endpoint.GetBody()].GetAABB();
+                endpoint.value = GetAxis(endpoint.IsMin() ? aabb.topLeft : aabb.botRight, axis);
+            }
+            SortAxis(m_endpoints[axis]);
+        }
+    }
+
+    void SortAxis(std::vector<SapEndpoint> & endpoints)
+    {
+        for (size_t i = 1; i < endpoints.size(); ++i)
+        {
+            auto endpoint = endpoints[i];
+            size_t j = i;
+            while (j > 0 && endpoint < endpoints[j - 1])
+            {
+                auto & prev = endpoints[j - 1];
+                if (endpoint.IsMin() && !prev.IsMin())
+                {
+                    //  Min passed other's max going left - overlap starts on this axis.
+                    if (Overlaps(endpoint.GetBody(), prev.GetBody()))
+                        AddPair(endpoint.GetBody(), prev.GetBody());
+                }
+                else if (!endpoint.IsMin() && prev.IsMin())
+                {
+                    //  Max passed other's min going left - overlap ends.
+                    RemovePair(endpoint.GetBody(), prev.GetBody());
+                }
+                endpoints[j] = prev;
+                --j;
+            }
+            endpoints[j] = endpoint;
+        }
+    }
+
+    bool Overlaps(uint32_t a, uint32_t b)
+    {
+        ++m_testCount;
+        return a != b && m_bodies[a].GetAABB().Intersects(m_bodies[b].GetAABB());
+    }
+
+    void AddPair(uint32_t a, uint32_t b)
+    {
+        if (m_pairs.Add(a, b))
+            ++m_pairsAdded;
+    }
+
+    void RemovePair(uint32_t a, uint32_t b)
+    {
+        if (m_pairs.Remove(a, b))
+            ++m_pairsRemoved;
+    }
+
+    static float GetAxis(const physVec2 & vec, uint8_t axis)
+    {
+        return axis == 0 ? vec.x : vec.y;
+    }
+
+    physBodyBufferSpan m_bodies;
+    std::vector<SapEndpoint> m_endpoints[2];
+
+    physPairSet m_pairs;
+
+    unsigned long long m_testCount = 0;
+    unsigned long long m_pairsAdded = 0;
+    unsigned long long m_pairsRemoved = 0;
+};
@@ -5,11 +5,18 @@
 
 #include "PhysicsBody.h"
 #include "PhysicsCollision.h"
+#include "PhysicsBroadPhase.h"
 #include "Benchmark.h"
 
 constexpr uint32_t OPEN_HASHING_TABLE_SIZE = 4001;
 constexpr uint32_t CLOSED_HASHING_TABLE_SIZE = 8009;
-constexpr uint32_t FIXED_GRID_CELL_SIZE = 25.f;
+constexpr float FIXED_GRID_CELL_SIZE = 25.f;
+
+constexpr uint32_t GRID_RETUNE_INTERVAL = 16;           //  Steps between cell size evaluations
+constexpr float GRID_RETUNE_HYSTERESIS = 0.2f;          //  Relative change of the cell size needed to rebuild the grid
+constexpr float GRID_TARGET_TESTS_PER_ENTRY = 1.f;
+constexpr float GRID_MIN_CELL_SCALE = 1.f;
+constexpr float GRID_MAX_CELL_SCALE = 8.f;
 
 #define PROBING_LINEAR 1
 #define PROBING_QUAD 2
@@ -20,7 +27,8 @@ struct IGrid
 {
     virtual ~IGrid(){}
     virtual void MapObjects(physBodyBufferSpan bodies) = 0;
-    virtual void Solve(physCollisionBuffer & collisions) = 0;
+    //  Returns the number of AABB tests performed.
+    virtual unsigned long long Solve(physCollisionBuffer & collisions) = 0;
     virtual void Clear() = 0;
     virtual int GetSize() = 0;
 };
@@ -36,14 +44,13 @@ struct FixedGrid : IGrid
         invCellSize(1.f/cellSize)
     {
         buckets.resize(width * height);
-        //  TODO:   Reserve or not?
-        for (auto bucket : buckets)
+        for (auto& bucket : buckets)
             bucket.reserve(8);
     }
 
     void MapObjects(physBodyBufferSpan bodies) override
     {
-        for (uint16_t i = 0; i < bodies.size; ++i)
+        for (uint32_t i = 0; i < bodies.size; ++i)
         {
             auto body = &bodies[i];
             auto& aabb = body->GetAABB();
@@ -53,11 +60,11 @@ struct FixedGrid : IGrid
             int16_t topmostExtent = int16_t((aabb.topLeft.y - topLeftCorner.y) * invCellSize);
             int16_t bottommostExtent = int16_t((aabb.botRight.y - topLeftCorner.y) * invCellSize);
 
-            constexpr int16_t zero = 0;
-            leftmostExtent = std::max(leftmostExtent, zero);
-            rightmostExtent = std::min(rightmostExtent, int16_t(width - 1));
-            topmostExtent = std::max(topmostExtent, zero);
-            bottommostExtent = std::min(bottommostExtent, int16_t(height - 1));
+            //  Bodies outside of the grid are kept in the border cells.
+            leftmostExtent = ClampX(leftmostExtent);
+            rightmostExtent = ClampX(rightmostExtent);
+            topmostExtent = ClampY(topmostExtent);
+            bottommostExtent = ClampY(bottommostExtent);
 
             for (auto j = leftmostExtent; j <= rightmostExtent; ++j)
                 for (auto k = topmostExtent; k <= bottommostExtent; ++k)
@@ -66,7 +73,7 @@ struct FixedGrid : IGrid
         
     }
 
-    void Solve(physCollisionBuffer & collisions) override
+    unsigned long long Solve(physCollisionBuffer & collisions) override
     {
         unsigned long long testCount = 0;
         for (auto& bucket : buckets)
@@ -85,7 +92,7 @@ struct FixedGrid : IGrid
                 }
             }
         }
-        Benchmark::Get().RegisterValue("TestCount", testCount);
+        return testCount;
     }
 
     void Clear() override
@@ -102,6 +109,16 @@ struct FixedGrid : IGrid
         return size;
     }
 
+    int16_t ClampX(int16_t x) const
+    {
+        return std::min(std::max(x, int16_t(0)), int16_t(width - 1));
+    }
+
+    int16_t ClampY(int16_t y) const
+    {
+        return std::min(std::max(y, int16_t(0)), int16_t(height - 1));
+    }
+
     physVec2 topLeftCorner;
     uint16_t width = 0;
     uint16_t height = 0;
@@ -120,14 +137,13 @@ struct OpenHashGrid : IGrid
         invCellSize(1.f/cellSize)
     {
         buckets.resize(numOfBuckets);
-        //  TODO:   Reserve or not?
-        for (auto bucket : buckets)
+        for (auto& bucket : buckets)
             bucket.reserve(8);
     }
 
     void MapObjects(physBodyBufferSpan bodies) override
     {
-        for (uint16_t i = 0; i < bodies.size; ++i)
+        for (uint32_t i = 0; i < bodies.size; ++i)
         {
             auto body = &bodies[i];
             auto& aabb = body->GetAABB();
@@ -148,7 +164,7 @@ struct OpenHashGrid : IGrid
         }
     }
 
-    void Solve(physCollisionBuffer & collisions)  override
+    unsigned long long Solve(physCollisionBuffer & collisions) override
     {
         unsigned long long testCount = 0;
 
@@ -160,6 +176,9 @@ struct OpenHashGrid : IGrid
                 {
                     auto b1 = bucket[i];
                     auto b2 = bucket[j];
+                    //  Cells of one body can hash to the same bucket
+                    if (b1 == b2)
+                        continue;
                     auto &aabb1 = b1->GetAABB();
                     auto &aabb2 = b2->GetAABB();
                     if (aabb1.Intersects(aabb2))
@@ -169,7 +188,7 @@ struct OpenHashGrid : IGrid
             }
         }
 
-        Benchmark::Get().RegisterValue("TestCount", testCount);
+        return testCount;
     }
 
     void Clear() override
@@ -205,10 +224,14 @@ struct ClosedHashGrid : IGrid
         hashTable = new physBody*[tableSize];
         ClosedHashGrid::Clear();
     }
+    ~ClosedHashGrid()
+    {
+        delete[] hashTable;
+    }
 
     void MapObjects(physBodyBufferSpan bodies) override
     {
-        for (uint16_t i = 0; i < bodies.size; ++i)
+        for (uint32_t i = 0; i < bodies.size; ++i)
         {
             auto body = &bodies[i];
             auto& aabb = body->GetAABB();
@@ -247,7 +270,7 @@ struct ClosedHashGrid : IGrid
         }
     }
 
-    void Solve(physCollisionBuffer & collisions) override
+    unsigned long long Solve(physCollisionBuffer & collisions) override
     {
         unsigned long long testCount = 0;
         for(int i = minLeftmostExtent; i <= maxRightmostExtent; ++i)
@@ -269,6 +292,9 @@ struct ClosedHashGrid : IGrid
                 {
                     for (auto bodyFromBucket : currentBucket)
                     {
+                        //  Probe sequence may visit the same slot twice
+                        if (bodyFromBucket == body)
+                            continue;
                         auto &aabb1 = body->GetAABB();
                         auto &aabb2 = bodyFromBucket->GetAABB();
                         if (aabb1.Intersects(aabb2))
@@ -285,7 +311,7 @@ struct ClosedHashGrid : IGrid
                 }
             }
         }
-        Benchmark::Get().RegisterValue("TestCount", testCount);
+        return testCount;
     }
 
     void Clear() override
@@ -343,79 +369,306 @@ struct ClosedHashGrid : IGrid
     physBody** hashTable;
 };
 
-class BroadPhaseUniformGrid
+//  Buckets of all cells in one array. MapObjects counts the entries of every cell first, the
+//  prefix sum of the counts gives each cell its range, and the second pass fills the ranges.
+
+struct FlatGrid : IGrid
+{
+    struct CellRange
+    {
+        int16_t left, right, top, bottom;
+    };
+
+    FlatGrid(const physVec2 & position, uint16_t width, uint16_t height, float cellSize) :
+        bodies(nullptr, 0),
+        topLeftCorner(position),
+        width(width),
+        height(height),
+        cellSize(cellSize),
+        invCellSize(1.f/cellSize)
+    {
+        cellStarts.resize(width * height + 1);
+    }
+
+    void MapObjects(physBodyBufferSpan bodies) override
+    {
+        this->bodies = bodies;
+        ranges.resize(bodies.size);
+        std::fill(cellStarts.begin(), cellStarts.end(), 0);
+
+        //  First pass: count entries per cell
+        for (uint32_t i = 0; i < bodies.size; ++i)
+        {
+            auto& aabb = bodies[i].GetAABB();
+            auto& range = ranges[i];
+            range.left = ClampX(int16_t((aabb.topLeft.x - topLeftCorner.x) * invCellSize));
+            range.right = ClampX(int16_t((aabb.botRight.x - topLeftCorner.x) * invCellSize));
+            range.top = ClampY(int16_t((aabb.topLeft.y - topLeftCorner.y) * invCellSize));
+            range.bottom = ClampY(int16_t((aabb.botRight.y - topLeftCorner.y) * invCellSize));
+
+            for (auto k = range.top; k <= range.bottom; ++k)
+                for (auto j = range.left; j <= range.right; ++j)
+                    ++cellStarts[k * width + j + 1];
+        }
+
+        for (size_t c = 1; c < cellStarts.size(); ++c)
+            cellStarts[c] += cellStarts[c - 1];
+
+        //  Second pass: fill, cellStarts[c + 1] is used as the write cursor of cell c and
+        //  ends up at the end of its range, which is the start of the next cell.
+        entries.resize(cellStarts.back());
+        for (uint32_t i = 0; i < bodies.size; ++i)
+        {
+            auto& range = ranges[i];
+            for (auto k = range.top; k <= range.bottom; ++k)
+                for (auto j = range.left; j <= range.right; ++j)
+                    entries[cellStarts[k * width + j]++] = i;
+        }
+        //  Shift back so cellStarts[c] is the first entry of cell c again.
+        for (size_t c = cellStarts.size() - 1; c > 0; --c)
+            cellStarts[c] = cellStarts[c - 1];
+        cellStarts[0] = 0;
+    }
+
+    unsigned long long Solve(physCollisionBuffer & collisions) override
+    {
+        return SolveCells(0, GetCellCount(), collisions);
+    }
+
+    //  Tests pairs of cells [firstCell, lastCell). Output is physCollisionBuffer or physPairList.
+    template<typename Output>
+    unsigned long long SolveCells(uint32_t firstCell, uint32_t lastCell, Output & output) const
+    {
+        unsigned long long testCount = 0;
+        for (uint32_t c = firstCell; c < lastCell; ++c)
+        {
+            const uint32_t begin = cellStarts[c];
+            const uint32_t end = cellStarts[c + 1];
+            for (uint32_t i = begin; i + 1 < end; ++i)
+            {
+                auto& b1 = bodies[entries[i]];
+                auto& aabb1 = b1.GetAABB();
+                for (uint32_t j = i + 1; j < end; ++j)
+                {
+                    auto& b2 = bodies[entries[j]];
+                    if (aabb1.Intersects(b2.GetAABB()))
+                        output.AppendCollision(&b1, &b2);
+                    ++testCount;
+                }
+            }
+        }
+        return testCount;
+    }
+
+    uint32_t GetCellCount() const
+    {
+        return uint32_t(cellStarts.size() - 1);
+    }
+
+    void Clear() override
+    {
+        entries.clear();
+    }
+
+    int GetSize() override
+    {
+        return int(entries.size());
+    }
+
+    int16_t ClampX(int16_t x) const
+    {
+        return std::min(std::max(x, int16_t(0)), int16_t(width - 1));
+    }
+
+    int16_t ClampY(int16_t y) const
+    {
+        return std::min(std::max(y, int16_t(0)), int16_t(height - 1));
+    }
+
+    physBodyBufferSpan bodies;
+    physVec2 topLeftCorner;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    float cellSize = 0.f;
+    float invCellSize = 0.f;
+
+    std::vector<CellRange> ranges;
+    std::vector<uint32_t> cellStarts;
+    std::vector<uint32_t> entries;
+};
+
+//  Cell size follows the mean AABB size of the bodies scaled by a factor, which is corrected
+//  every GRID_RETUNE_INTERVAL steps from the measured tests per grid entry. The grid (and the
+//  hash table size) is rebuilt only when the cell size moves by more than the hysteresis.
+
+class BroadPhaseUniformGrid : public physBroadPhase
 {
 public:
-    explicit BroadPhaseUniformGrid(physBodyBufferSpan & bodies, const physVec2 & topLeftCornerPosition, const physVec2 & sizeExtents) : 
-        m_bodies(bodies)
-    {
-        auto cellSize = CalculateCellSize();
-#if (BP == BP_UNIFORM_FIXED) || (BP == BP_UNIFORM)
-        auto width = uint16_t(sizeExtents.x / cellSize) + 1;
-        auto height = uint16_t(sizeExtents.y / cellSize) + 1;
-        m_grid = new FixedGrid(topLeftCornerPosition, width, height, cellSize);
-#elif BP == BP_UNIFORM_OPENHASH
-        m_grid = new OpenHashGrid(topLeftCornerPosition, OPEN_HASHING_TABLE_SIZE, cellSize);
-#elif BP == BP_UNIFORM_CLOSEDHASH
-        m_grid = new ClosedHashGrid(topLeftCornerPosition, CLOSED_HASHING_TABLE_SIZE, cellSize);
-#endif
+    //  Type selects the grid storage: bpUniformFixed, bpUniformFlat, bpUniformOpenHash or bpUniformClosedHash.
+    explicit BroadPhaseUniformGrid(Type type, const physVec2 & topLeftCornerPosition, const physVec2 & sizeExtents) : 
+        m_bodies(nullptr, 0),
+        m_type(type),
+        m_topLeftCorner(topLeftCornerPosition),
+        m_sizeExtents(sizeExtents)
+    {
     }
     ~BroadPhaseUniformGrid()
     {
         delete m_grid;
     }
 
-    void SetBodies(physBodyBufferSpan & bodies);
-    void Solve(physCollisionBuffer & collisions) const;
+    void SetBodies(physBodyBufferSpan & bodies) override;
+    void Solve(physCollisionBuffer & collisions) override;
 
 private:
-
-    float CalculateCellSize() const;
+    void Tune();
+    void CreateGrid(float cellSize, uint32_t maxEntries);
 
     physBodyBufferSpan m_bodies;
-    IGrid *m_grid;
+    IGrid *m_grid = nullptr;
+
+    Type m_type;
+    physVec2 m_topLeftCorner;
+    physVec2 m_sizeExtents;
+
+    float m_cellSize = FIXED_GRID_CELL_SIZE;
+    float m_cellScale = 2.f;
+    uint32_t m_stepsSinceTune = 0;
+    unsigned long long m_testsSinceTune = 0;
+    unsigned long long m_entriesSinceTune = 0;
 };
 
 inline void BroadPhaseUniformGrid::SetBodies(physBodyBufferSpan & bodies)
 {
+    bool bodiesChanged = bodies.size != m_bodies.size || bodies.chunks != m_bodies.chunks;
     m_bodies = bodies;
+    if (m_grid == nullptr || bodiesChanged || m_stepsSinceTune >= GRID_RETUNE_INTERVAL)
+        Tune();
 }
 
-inline void BroadPhaseUniformGrid::Solve(physCollisionBuffer& collisions) const
+inline void BroadPhaseUniformGrid::Solve(physCollisionBuffer& collisions)
 {
     m_grid->MapObjects(m_bodies);
-    Benchmark::Get().RegisterValue("Size", m_grid->GetSize());
-    m_grid->Solve(collisions);
+    auto size = m_grid->GetSize();
+    unsigned long long testCount;
+    if (m_threadPool != nullptr && m_type == bpUniformFlat)
+    {
+        auto grid = static_cast<FlatGrid*>(m_grid);
+        auto cellCount = grid->GetCellCount();
+        testCount = SolveParallel(BROAD_PHASE_TASK_COUNT, collisions, [&](uint32_t taskIdx, physPairList & pairs)
+        {
+            return grid->SolveCells(cellCount * taskIdx / BROAD_PHASE_TASK_COUNT,
+                                    cellCount * (taskIdx + 1) / BROAD_PHASE_TASK_COUNT, pairs);
+        });
+    }
+    else
+        testCount = m_grid->Solve(collisions);
     m_grid->Clear();
-}
 
+    ++m_stepsSinceTune;
+    m_testsSinceTune += testCount;
+    m_entriesSinceTune += size;
 
-//  TODO:   Research more strategies concerning cell size calculations
-inline float BroadPhaseUniformGrid::CalculateCellSize() const
+    PHYS_PROFILE_VALUE(TestCount, testCount);
+    PHYS_PROFILE_VALUE(Size, size);
+    PHYS_PROFILE_VALUE(CellSize, m_cellSize);
+}
+
+inline void BroadPhaseUniformGrid::Tune()
 {
-#if 0
-    //  Largest Object Strategy
-    constexpr auto SQRT2 = float(M_SQRT2);
-    float largestExtent = 0;
-    for(uint16_t i = 0; i < m_bodies.size; ++i)
-    {
-        auto& aabb = m_bodies[i].GetAABB();
-        auto extents = aabb.GetExtents() * 2;
-        largestExtent = std::max(largestExtent, std::max(extents.x, extents.y));
-    }
-    return largestExtent * SQRT2;
-#elif 0
-    //  Average Object Strategy
+    //  Too many tests per entry means crowded cells, too few means bodies spread over many cells.
+    if (m_entriesSinceTune > 0)
+    {
+        float testsPerEntry = float(m_testsSinceTune) / m_entriesSinceTune;
+        float correction = sqrtf(GRID_TARGET_TESTS_PER_ENTRY / std::max(testsPerEntry, 0.01f));
+        correction = std::min(std::max(correction, 0.8f), 1.25f);
+        m_cellScale = std::min(std::max(m_cellScale * correction, GRID_MIN_CELL_SCALE), GRID_MAX_CELL_SCALE);
+    }
+    m_stepsSinceTune = 0;
+    m_testsSinceTune = 0;
+    m_entriesSinceTune = 0;
+
     float sumOfExtents = 0;
-    for (uint16_t i = 0; i < m_bodies.size; ++i)
+    for (uint32_t i = 0; i < m_bodies.size; ++i)
     {
-        auto& aabb = m_bodies[i].GetAABB();
-        auto extents = aabb.GetExtents() * 2;
+        auto extents = m_bodies[i].GetAABB().GetExtents() * 2;
         sumOfExtents += std::max(extents.x, extents.y);
     }
-    return sumOfExtents / m_bodies.size;
-#else 
-    //  Fixed size
-    return FIXED_GRID_CELL_SIZE;
-#endif
+    float cellSize = m_bodies.size > 0 ? m_cellScale * sumOfExtents / m_bodies.size : FIXED_GRID_CELL_SIZE;
+    cellSize = std::max(cellSize, 1.f);
+
+    if (m_grid != nullptr && fabsf(cellSize - m_cellSize) <= GRID_RETUNE_HYSTERESIS * m_cellSize)
+        cellSize = m_cellSize;
+
+    //  Upper bound of cells covered by all bodies, hash tables are kept at most half full.
+    uint32_t maxEntries = 0;
+    for (uint32_t i = 0; i < m_bodies.size; ++i)
+    {
+        auto extents = m_bodies[i].GetAABB().GetExtents() * 2;
+        maxEntries += (uint32_t(extents.x / cellSize) + 2) * (uint32_t(extents.y / cellSize) + 2);
+    }
+
+    CreateGrid(cellSize, maxEntries);
+}
+
+inline uint32_t NextPrime(uint32_t n)
+{
+    auto isPrime = [](uint32_t x)
+    {
+        if (x < 2) return false;
+        for (uint32_t d = 2; d * d <= x; ++d)
+            if (x % d == 0) return false;
+        return true;
+    };
+    while (!isPrime(n))
+        ++n;
+    return n;
+}
+
+inline void BroadPhaseUniformGrid::CreateGrid(float cellSize, uint32_t maxEntries)
+{
+    switch (m_type)
+    {
+    case bpUniformOpenHash:
+    {
+        auto numOfBuckets = std::max(OPEN_HASHING_TABLE_SIZE, NextPrime(maxEntries));
+        auto grid = dynamic_cast<OpenHashGrid*>(m_grid);
+        if (grid != nullptr && grid->cellSize == cellSize && grid->numOfBuckets >= numOfBuckets)
+            return;
+        delete m_grid;
+        m_grid = new OpenHashGrid(m_topLeftCorner, numOfBuckets, cellSize);
+        break;
+    }
+    case bpUniformClosedHash:
+    {
+        auto tableSize = std::max(CLOSED_HASHING_TABLE_SIZE, NextPrime(maxEntries * 2));
+        auto grid = dynamic_cast<ClosedHashGrid*>(m_grid);
+        if (grid != nullptr && grid->cellSize == cellSize && grid->tableSize >= tableSize)
+            return;
+        delete m_grid;
+        m_grid = new ClosedHashGrid(m_topLeftCorner, tableSize, cellSize);
+        break;
+    }
+    case bpUniformFlat:
+    {
+        if (m_grid != nullptr && m_cellSize == cellSize)
+            return;
+        auto width = uint16_t(m_sizeExtents.x / cellSize) + 1;
+        auto height = uint16_t(m_sizeExtents.y / cellSize) + 1;
+        delete m_grid;
+        m_grid = new FlatGrid(m_topLeftCorner, width, height, cellSize);
+        break;
+    }
+    default:
+    {
+        if (m_grid != nullptr && m_cellSize == cellSize)
+            return;
+        auto width = uint16_t(m_sizeExtents.x / cellSize) + 1;
+        auto height = uint16_t(m_sizeExtents.y / cellSize) + 1;
+        delete m_grid;
+        m_grid = new FixedGrid(m_topLeftCorner, width, height, cellSize);
+        break;
+    }
+    }
+    m_cellSize = cellSize;
 }
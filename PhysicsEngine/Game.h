@@ -2,6 +2,7 @@
 
 #include <vector>
 #include "PhysicsWorld.h"
+#include "Scenes.h"
 #include "SFML/Graphics.hpp"
 
 struct Game
@@ -9,19 +10,13 @@ struct Game
     physWorld world;
     bool drawAABB = false;
     bool drawContactPoints = false;
+    int bodyCount = 500;    //  Bodies in the crowded scenes
 
     std::vector<physBody*> bodies;
 
     void Init();
 
-    void InitScene1();
-    void InitScene2();
-    void InitScene3();
-    void InitScene4();
-    void InitScene5();
-
-    void InitScene6();
-    void InitScene7();
+    void LoadScene(int sceneIdx);
 
     void Update(const float dt);
     void Render(sf::RenderWindow & rw);
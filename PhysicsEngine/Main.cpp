@@ -9,44 +9,20 @@
 constexpr float FPS = 180.f;
 constexpr float speedFactor = 1;
 
-constexpr unsigned BENCHMARK_BUFFER_SIZE = 100;
+//  Steps summarized by each printed report.
+constexpr unsigned BENCHMARK_REPORT_STEPS = 180;
 
 void PrintBenchmark()
 {
-    using namespace std;
-
-    static MovingAverage maCnt(BENCHMARK_BUFFER_SIZE);
-    static MovingAverage maMs(BENCHMARK_BUFFER_SIZE);
-    static MovingAverage testCnt(BENCHMARK_BUFFER_SIZE);
-    static MovingAverage allCol(BENCHMARK_BUFFER_SIZE);
-    static MovingAverage filtrCol(BENCHMARK_BUFFER_SIZE);
-    static MovingAverage sizes(BENCHMARK_BUFFER_SIZE);
-
-    auto result =  Benchmark::Get().PopResult("Collision");
-    auto resultMs = result.milli();
-
-    auto getVal = [](const std::string& valName) { return Benchmark::Get().PopValue(valName); };
-
-    auto testCount = getVal("TestCount");
-    auto allCols = getVal("AllCollisions");
-    auto uqCols = getVal("UniqueCollisions");
-    auto size = getVal("Size");
-
-    cout << "#####"                                                 << endl;
-    cout << "Cycles: \t" <<                 result.count            << endl;
-    cout << "Cycles avg: \t" <<             maCnt.Get(result.count) << endl;
-    cout << setprecision(3);
-    cout << "Ms: \t \t" <<                  resultMs                << endl;
-    cout << "Avg Ms: \t" <<                 maMs.Get(resultMs)      << endl;
-    cout << setprecision(2);
-    cout << "Number of tests: \t" <<        testCount               << endl;
-    cout << "Number of tests avg: \t" <<    testCnt.Get(testCount)  << endl;
-    cout << "All collisions: \t" <<         allCols                 << endl;
-    cout << "All collisions avg: \t" <<     allCol.Get(allCols)     << endl;
-    cout << "Unique collisions: \t" <<      uqCols                  << endl;
-    cout << "Unique collisions avg: \t" <<  filtrCol.Get(uqCols)    << endl;
-    cout << "Size: \t \t \t" <<             size                    << endl;
-    cout << "Size avg: \t \t" <<            sizes.Get(size) << endl << endl;
+    static StepStatistics statistics;
+    statistics.Sample();
+    if (statistics.GetZone(0).GetCount() < BENCHMARK_REPORT_STEPS)
+        return;
+
+    std::cout << "#####" << std::endl;
+    statistics.Print(std::cout);
+    std::cout << std::endl;
+    statistics.Reset();
 }
 
 void main(void)
@@ -59,6 +35,9 @@ void main(void)
 	sf::Time frameTime = sf::seconds(speedFactor / FPS);
 	sf::Clock fpsCounter;
 
+    //  Adds IPC and cache miss rates to the report where hardware counters are available.
+    Benchmark::Get().EnableCounters();
+
 	Game *game = new Game();
 	game->Init();
 
@@ -85,17 +64,20 @@ void main(void)
 				break;
 			}
 		}
-        Benchmark::Get().RunTimer("Total");
-        Benchmark::Get().RunTimer("Update");
-		game->Update(frameTime.asSeconds());
-        Benchmark::Get().StopTimer("Update");
-        Benchmark::Get().RunTimer("Render");
-        game->Render(simulationWindow);
-        Benchmark::Get().StopTimer("Render");
-        Benchmark::Get().StopTimer("Total");
+        {
+            PHYS_PROFILE_ZONE(Total);
+            {
+                PHYS_PROFILE_ZONE(Update);
+                game->Update(frameTime.asSeconds());
+            }
+            {
+                PHYS_PROFILE_ZONE(Render);
+                game->Render(simulationWindow);
+            }
+        }
 
         PrintBenchmark();
-        //if (iterations++ >= BENCHMARK_BUFFER_SIZE + 5)
+        //if (iterations++ >= BENCHMARK_REPORT_STEPS + 5)
         //    simulationWindow.close();
 	}
     delete game;
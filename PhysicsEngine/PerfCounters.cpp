@@ -0,0 +1,152 @@
+#include "PerfCounters.h"
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfCounters::PerfCounters()
+    : m_leader(-1), m_groupSize(0)
+{
+    for (uint32_t i = 0; i < PerfSample::EVENT_COUNT; ++i)
+    {
+        m_fds[i] = -1;
+        m_groupIndex[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    Close();
+}
+
+#if defined(__linux__)
+
+namespace
+{
+    void DescribeEvent(PerfEvent event, perf_event_attr & attr)
+    {
+        auto cacheMiss = [&](uint64_t cache)
+        {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+
+        switch (event)
+        {
+        case PerfEvent::Cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::L1DMisses:
+            cacheMiss(PERF_COUNT_HW_CACHE_L1D);
+            break;
+        case PerfEvent::LLCMisses:
+            cacheMiss(PERF_COUNT_HW_CACHE_LL);
+            break;
+        case PerfEvent::BranchMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool PerfCounters::Open()
+{
+    Close();
+    for (uint32_t i = 0; i < PerfSample::EVENT_COUNT; ++i)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        DescribeEvent(PerfEvent(i), attr);
+        attr.disabled = m_leader < 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        //  This thread, any CPU. Events the CPU lacks are skipped and read as zero.
+        int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0));
+        if (fd < 0)
+            continue;
+        if (m_leader < 0)
+            m_leader = fd;
+        m_fds[i] = fd;
+        m_groupIndex[i] = int(m_groupSize++);
+    }
+    if (m_leader < 0)
+        return false;
+
+    ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+void PerfCounters::Close()
+{
+    for (uint32_t i = 0; i < PerfSample::EVENT_COUNT; ++i)
+    {
+        if (m_fds[i] >= 0)
+            close(m_fds[i]);
+        m_fds[i] = -1;
+        m_groupIndex[i] = -1;
+    }
+    m_leader = -1;
+    m_groupSize = 0;
+}
+
+void PerfCounters::Read(PerfSample & sample) const
+{
+    sample = PerfSample();
+    if (m_leader < 0)
+        return;
+
+    //  PERF_FORMAT_GROUP layout: the number of events followed by their values in open order.
+    uint64_t data[1 + PerfSample::EVENT_COUNT];
+    if (read(m_leader, data, sizeof(uint64_t) * (1 + m_groupSize)) <= 0)
+        return;
+    for (uint32_t i = 0; i < PerfSample::EVENT_COUNT; ++i)
+        if (m_groupIndex[i] >= 0 && uint64_t(m_groupIndex[i]) < data[0])
+            sample.values[i] = data[1 + m_groupIndex[i]];
+}
+
+#else
+
+bool PerfCounters::Open()
+{
+    return false;
+}
+
+void PerfCounters::Close()
+{
+}
+
+void PerfCounters::Read(PerfSample & sample) const
+{
+    sample = PerfSample();
+}
+
+#endif
+
+const char* PerfCounters::GetName(PerfEvent event)
+{
+    switch (event)
+    {
+    case PerfEvent::Cycles:         return "Cycles";
+    case PerfEvent::Instructions:   return "Instructions";
+    case PerfEvent::L1DMisses:      return "L1DMisses";
+    case PerfEvent::LLCMisses:      return "LLCMisses";
+    case PerfEvent::BranchMisses:   return "BranchMisses";
+    default:                        return "Unknown";
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+
+//  Hardware performance counters of the calling thread, opened as one perf_event_open group so
+//  all events cover the same instructions. On other platforms, or when the kernel denies access
+//  (see /proc/sys/kernel/perf_event_paranoid), Open fails and reads return zeros.
+
+enum class PerfEvent : uint8_t
+{
+    Cycles,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+    Count
+};
+
+struct PerfSample
+{
+    static constexpr uint32_t EVENT_COUNT = uint32_t(PerfEvent::Count);
+
+    uint64_t values[EVENT_COUNT] = {};
+
+    uint64_t operator[](PerfEvent event) const { return values[uint32_t(event)]; }
+
+    PerfSample & operator+=(const PerfSample & rhs)
+    {
+        for (uint32_t i = 0; i < EVENT_COUNT; ++i)
+            values[i] += rhs.values[i];
+        return *this;
+    }
+
+    PerfSample operator-(const PerfSample & rhs) const
+    {
+        PerfSample result;
+        for (uint32_t i = 0; i < EVENT_COUNT; ++i)
+            result.values[i] = values[i] - rhs.values[i];
+        return result;
+    }
+
+    //  Instructions per cycle.
+    double GetIPC() const
+    {
+        auto cycles = (*this)[PerfEvent::Cycles];
+        return cycles ? double((*this)[PerfEvent::Instructions]) / cycles : 0.0;
+    }
+
+    //  Events per thousand instructions, e.g. cache misses per kilo-instruction.
+    double GetPerKiloInstruction(PerfEvent event) const
+    {
+        auto instructions = (*this)[PerfEvent::Instructions];
+        return instructions ? (*this)[event] * 1000.0 / instructions : 0.0;
+    }
+};
+
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    void operator=(const PerfCounters&) = delete;
+
+    //  Opens and starts the counters that the CPU and kernel support. Returns false if none.
+    bool Open();
+    void Close();
+
+    bool IsOpen() const { return m_leader >= 0; }
+    bool IsSupported(PerfEvent event) const { return m_groupIndex[uint32_t(event)] >= 0; }
+
+    //  Running totals since Open, unsupported events stay zero.
+    void Read(PerfSample & sample) const;
+
+    static const char* GetName(PerfEvent event);
+
+private:
+    int m_leader;
+    int m_fds[PerfSample::EVENT_COUNT];
+    int m_groupIndex[PerfSample::EVENT_COUNT];
+    uint32_t m_groupSize;
+};
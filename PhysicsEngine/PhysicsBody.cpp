@@ -1,71 +1,108 @@
 #include "PhysicsBody.h"
 #include <algorithm>
+#include <cfloat>
 
 physBody::physBody()
 {
+	m_id = UINT32_MAX;
 	m_static = false;
+	m_sleeping = false;
+	m_sleepTime = 0;
 	m_density = 1.f;
-	m_rotation = 0.f;
-	m_angularVel = 0.f;
-	m_torque = 0.f;
 	m_restitution = 0.5f;
 	m_staticFriction = 0.3f;
 	m_dynamicFriction = 0.2f;
 	m_shape = nullptr;
+	m_shapeType = physShape::sCount;
+	m_state = nullptr;
+	m_slot = 0;
 	m_mass = 0;
-	m_invMass = 0;
 	m_I = 0;
-	m_invI = 0;
 }
 
-void physBody::InitializePoly(physPolyShape * polyShape)
+void physBody::ResetState()
+{
+	m_state->position[m_slot] = 0;
+	m_state->rotation[m_slot].setIdentity();
+	m_state->linearVel[m_slot] = 0;
+	m_state->angularVel[m_slot] = 0.f;
+	m_state->force[m_slot] = 0;
+	m_state->torque[m_slot] = 0.f;
+	m_state->invMass[m_slot] = 0.f;
+	m_state->invI[m_slot] = 0.f;
+	m_state->gravityScale[m_slot] = 1.f;
+	m_state->circleRadius[m_slot] = 0.f;
+	m_state->aabb[m_slot] = physAABB();
+	m_state->awake[m_slot] = 1;
+	++m_state->awakeCount;
+}
+
+void physBody::InitializePoly(physPolyShape * polyShape, physPolyHandle worldPolygon)
 {
 	m_shape = polyShape;
+	m_shapeType = physShape::sPoly;
 	m_shape->Initialize();
+	m_worldPolygon = worldPolygon;
+	m_state->circleRadius[m_slot] = 0.f;
 	CalculateMassData();
 }
 
 void physBody::InitializeCircle(physCircleShape * circleShape)
 {
 	m_shape = circleShape;
+	m_shapeType = physShape::sCircle;
 	m_shape->Initialize();
+	m_state->circleRadius[m_slot] = circleShape->GetRadius();
 	CalculateMassData();
 }
 
-void physBody::Refresh()
-{
-	m_force = 0;
-	m_torque = 0;
-}
-
 void physBody::ApplyForce(const physVec2 & force, const physVec2& contactVector)
 {
 	if (m_static)
 		return;
-	m_force += force;
-	m_torque += force.cross(contactVector);
+	SetAwake();
+	m_state->force[m_slot] += force;
+	m_state->torque[m_slot] += force.cross(contactVector);
 }
 
 void physBody::ApplyImpulse(const physVec2 & impulse, const physVec2 & contactVector)
 {
 	if (m_static)
 		return;
-	m_linearVel += impulse * m_invMass;
-	m_angularVel += contactVector.cross(impulse) * m_invI;
+	SetAwake();
+	m_state->linearVel[m_slot] += impulse * m_state->invMass[m_slot];
+	m_state->angularVel[m_slot] += contactVector.cross(impulse) * m_state->invI[m_slot];
 }
 
 void physBody::SetStatic(bool flag)
 {
+	bool wasAwake = IsAwake();
+
 	if (flag)
 	{
 		m_mass = 0;
-		m_invMass = 0;
+		m_state->invMass[m_slot] = 0;
 		m_I = 0;
-		m_invI = 0;
+		m_state->invI[m_slot] = 0;
+		m_state->linearVel[m_slot] = 0;
+		m_state->angularVel[m_slot] = 0;
 	}
 	else
 		CalculateMassData();
+	m_state->gravityScale[m_slot] = flag ? 0.f : 1.f;
 	m_static = flag;
+	m_sleeping = false;
+	m_sleepTime = 0;
+	m_state->awake[m_slot] = uint8_t(IsAwake());
+	if (IsAwake() != wasAwake)
+	{
+		if (wasAwake)
+			--m_state->awakeCount;
+		else
+			++m_state->awakeCount;
+	}
+	UpdateWorldPolygon();
+	CalculateAABB();
 }
 
 bool physBody::IsStatic()
@@ -73,17 +110,64 @@ bool physBody::IsStatic()
 	return m_static;
 }
 
+void physBody::SetAwake(bool flag)
+{
+	if (m_static || m_sleeping != flag)
+		return;
+
+	m_sleeping = !flag;
+	m_sleepTime = 0;
+	if (flag)
+	{
+		++m_state->awakeCount;
+		m_state->awake[m_slot] = 1;
+		m_state->gravityScale[m_slot] = 1.f;
+		return;
+	}
+
+	//	Zeroed like a static body, so the integration sweeps of its chunk leave it in place.
+	--m_state->awakeCount;
+	m_state->awake[m_slot] = 0;
+	m_state->gravityScale[m_slot] = 0.f;
+	m_state->linearVel[m_slot] = 0;
+	m_state->angularVel[m_slot] = 0;
+	m_state->force[m_slot] = 0;
+	m_state->torque[m_slot] = 0;
+	//	Positional correction moved it after the step transformed it.
+	UpdateWorldPolygon();
+	CalculateAABB();
+}
+
+bool physBody::IsAwake() const
+{
+	return !m_static && !m_sleeping;
+}
+
 void physBody::SetPosition(const physVec2 & pos)
 {
 	//m_transform.pos = pos;
-	m_position = pos;
+	m_state->position[m_slot] = pos;
+	OnMoved();
 }
 
 void physBody::SetRotation(float angle)
 {
 	//m_transform.rot.set(angle);
 	//m_rotation.set(angle);
-	m_rotation.set(angle);
+	m_state->rotation[m_slot].set(angle);
+	OnMoved();
+}
+
+void physBody::OnMoved()
+{
+	//	Steps skip static bodies, they are transformed when moved. A sleeping one wakes up.
+	if (m_static)
+	{
+		UpdateWorldPolygon();
+		CalculateAABB();
+	}
+	else
+		SetAwake();
 }
 
 void physBody::SetDensity(float density)
@@ -134,27 +218,32 @@ physShape * physBody::GetShape() const
 
 physAABB & physBody::GetAABB()
 {
-	return m_aabb;
+	return m_state->aabb[m_slot];
 }
 
 physVec2 physBody::GetPos() const
 {
-	return m_position;
+	return m_state->position[m_slot];
 }
 
 physRot physBody::GetRot() const
 {
-	return m_rotation;
+	return m_state->rotation[m_slot];
+}
+
+const physPolyHandle & physBody::GetWorldPolygon() const
+{
+	return m_worldPolygon;
 }
 
-physVec2 physBody::GetLinearVelocity()
+physVec2 physBody::GetLinearVelocity() const
 {
-	return m_linearVel;
+	return m_state->linearVel[m_slot];
 }
 
-float physBody::GetAngularVelocity()
+float physBody::GetAngularVelocity() const
 {
-	return m_angularVel;
+	return m_state->angularVel[m_slot];
 }
 
 float physBody::GetMass()
@@ -164,7 +253,7 @@ float physBody::GetMass()
 
 float physBody::GetInvMass()
 {
-	return m_invMass;
+	return m_state->invMass[m_slot];
 }
 
 float physBody::GetI()
@@ -174,7 +263,7 @@ float physBody::GetI()
 
 float physBody::GetInvI()
 {
-	return m_invI;
+	return m_state->invI[m_slot];
 }
 
 void physBody::CalculateMassData()
@@ -183,21 +272,21 @@ void physBody::CalculateMassData()
 	m_I = 0.f;
 
 	m_mass = m_density * m_shape->GetArea();
-	m_invMass = 1.f / m_mass;
+	m_state->invMass[m_slot] = 1.f / m_mass;
 
 	// http://mathoverflow.net/questions/73556/calculating-moment-of-inertia-in-2d-planar-polygon
 
-	switch (m_shape->GetType())
+	switch (m_shapeType)
 	{
 		case physShape::sCircle:
 		{
-			physCircleShape *c = dynamic_cast<physCircleShape*>(m_shape);
+			physCircleShape *c = static_cast<physCircleShape*>(m_shape);
 			m_I = static_cast<float>(M_PI_2) * powf(c->GetRadius(), 4);
 			break;
 		}
 		case physShape::sPoly:
 		{
-			physPolyShape *p = dynamic_cast<physPolyShape*>(m_shape);
+			physPolyShape *p = static_cast<physPolyShape*>(m_shape);
 			physPolyHandle &ph = p->GetPolygon();
 			for (unsigned int i = 0; i < ph.GetCount() - 1; ++i)
 			{
@@ -218,34 +307,29 @@ void physBody::CalculateMassData()
 		}
 	}
 
-	m_invI = 1.f / m_I;
+	m_state->invI[m_slot] = 1.f / m_I;
 }
 
 void physBody::CalculateAABB()
 {
-	if (GetShape()->GetType() == physShape::Type::sCircle)
+	if (m_shapeType == physShape::Type::sCircle)
 	{
-		physCircleShape *cs = dynamic_cast<physCircleShape*>(GetShape());
+		physCircleShape *cs = static_cast<physCircleShape*>(GetShape());
 		float rad = cs->GetRadius();
-		m_aabb = physAABB(m_position + physVec2(-rad, -rad), m_position + physVec2(rad, rad));
+		auto & pos = m_state->position[m_slot];
+		m_state->aabb[m_slot] = physAABB(pos + physVec2(-rad, -rad), pos + physVec2(rad, rad));
 	}
-	else if (GetShape()->GetType() == physShape::Type::sPoly)
+	else if (m_shapeType == physShape::Type::sPoly)
 	{
-		physPolyShape *ps = dynamic_cast<physPolyShape*>(GetShape());
-
-		auto ph = ps->GetPolygon();
-
 		float left = FLT_MAX;
 		float top = FLT_MAX;
 		float right = -FLT_MAX;
 		float bottom = -FLT_MAX;
 
-		auto rot = GetRot();
-
-		for (uint32_t i = 0; i < ph.GetCount(); ++i)
+		auto vertices = m_worldPolygon.GetVertices();
+		for (uint32_t i = 0; i < m_worldPolygon.GetCount(); ++i)
 		{
-			physVec2 vec = ph.At(i).position;
-			vec.rotate(rot);
+			physVec2 vec = vertices[i].position;
 
 			left = std::min(left, vec.x);
 			right = std::max(right, vec.x);
@@ -253,23 +337,56 @@ void physBody::CalculateAABB()
 			bottom = std::max(bottom, vec.y);
 		}
 
-		m_aabb = physAABB(m_position + physVec2(left, top), m_position + physVec2(right, bottom));
+		m_state->aabb[m_slot] = physAABB(physVec2(left, top), physVec2(right, bottom));
 	}
 }
 
-void physBodyBuffer::Reset()
+void physBody::UpdateWorldPolygon()
 {
-    count = 0;
+	if (m_shapeType != physShape::Type::sPoly)
+		return;
+
+	auto &local = static_cast<physPolyShape*>(GetShape())->GetPolygon();
+	auto localVertices = local.GetVertices();
+	auto worldVertices = m_worldPolygon.GetVertices();
+	auto rot = GetRot();
+	auto pos = GetPos();
+	for (uint32_t i = 0; i < local.GetCount(); ++i)
+	{
+		worldVertices[i].position = localVertices[i].position;
+		worldVertices[i].position.rotate(rot);
+		worldVertices[i].position += pos;
+		worldVertices[i].normal = localVertices[i].normal;
+		worldVertices[i].normal.rotate(rot);
+	}
 }
 
-void physBodyBuffer::ResetHard()
+physBody & physBodyBuffer::Append()
+{
+    uint32_t idx = GetCount();
+    Reserve(idx + 1);
+    auto & body = bodies.Append();
+    body.m_state = states[idx >> BODY_CHUNK_SHIFT].get();
+    body.m_slot = idx & BODY_CHUNK_MASK;
+    body.ResetState();
+    return body;
+}
+
+void physBodyBuffer::Reserve(uint32_t capacity)
+{
+    bodies.Reserve(capacity);
+    while (states.size() < bodies.GetCapacity() >> BODY_CHUNK_SHIFT)
+        states.emplace_back(new physBodyStateChunk());
+}
+
+void physBodyBuffer::Reset()
 {
-    for (uint32_t i = 0; i < count; ++i)
-        bodies[i] = physBody();
-    Reset();
+    bodies.Clear();
+    for (auto & state : states)
+        state->awakeCount = 0;
 }
 
-physBodyBufferSpan physBodyBuffer::AsSpan()
+physBodyBufferSpan physBodyBuffer::AsSpan() const
 {
-    return physBodyBufferSpan(bodies, count);
+    return physBodyBufferSpan(bodies.GetChunks(), bodies.GetSize());
 }
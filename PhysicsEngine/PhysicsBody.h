@@ -2,10 +2,40 @@
 
 #include "PhysicsShape.h"
 #include "PhysicsSettings.h"
+#include "PhysicsStorage.h"
+
+//  Bodies are stored in chunks of 2^BODY_CHUNK_SHIFT, pointers to them never change.
+constexpr uint32_t BODY_CHUNK_SHIFT = 10;
+constexpr uint32_t BODY_CHUNK_SIZE = 1u << BODY_CHUNK_SHIFT;
+constexpr uint32_t BODY_CHUNK_MASK = BODY_CHUNK_SIZE - 1;
+
+//  State every step reads and writes, one array per field for the bodies of one chunk, so
+//  integration and the AABB refresh sweep each field linearly. physBody keeps the cold data
+//  and reaches its hot state through its chunk and slot.
+struct physBodyStateChunk
+{
+    physVec2 position[BODY_CHUNK_SIZE];
+    physRot rotation[BODY_CHUNK_SIZE];
+    physVec2 linearVel[BODY_CHUNK_SIZE];
+    float angularVel[BODY_CHUNK_SIZE];
+    physVec2 force[BODY_CHUNK_SIZE];
+    float torque[BODY_CHUNK_SIZE];
+    float invMass[BODY_CHUNK_SIZE];
+    float invI[BODY_CHUNK_SIZE];
+    float gravityScale[BODY_CHUNK_SIZE];    //  0 for static and sleeping bodies
+    float circleRadius[BODY_CHUNK_SIZE];    //  0 for polygons
+    physAABB aabb[BODY_CHUNK_SIZE];
+    uint8_t awake[BODY_CHUNK_SIZE];         //  0 for static and sleeping bodies
+
+    //  Dynamic bodies of the chunk that are awake. The step skips the chunk at 0, otherwise
+    //  it integrates and refreshes runs of awake slots, see INTEGRATE_SLICE_GAP.
+    uint32_t awakeCount = 0;
+};
 
 class physBody
 {
 	friend class physWorld;
+	friend struct physBodyBuffer;
 
 public:
 	physBody();
@@ -16,11 +46,16 @@ public:
 	void SetStatic(bool flag = true);
 	bool IsStatic();
 
+	//	A sleeping body keeps still and is skipped by the step until it is touched by an awake
+	//	body, pushed or moved. Static bodies are never awake.
+	void SetAwake(bool flag = true);
+	bool IsAwake() const;
+
 	void SetPosition(const physVec2& pos);
 	void SetRotation(float angle);
 
-	physVec2 GetLinearVelocity();
-	float GetAngularVelocity();
+	physVec2 GetLinearVelocity() const;
+	float GetAngularVelocity() const;
 
 	float GetMass();
 	float GetInvMass();
@@ -37,35 +72,43 @@ public:
 	float GetStaticFriction() const;
 	float GetDynamicFriction() const;
 
+	uint32_t GetId() const { return m_id; }
 	physShape *GetShape() const;
+	physShape::Type GetShapeType() const { return m_shapeType; }
 	physAABB & GetAABB();
 	physVec2 GetPos() const;
 	physRot GetRot() const;
 
+	//	Vertices and normals of a polygon body in world space, as of the last step or the last
+	//	move of a static body.
+	const physPolyHandle & GetWorldPolygon() const;
+
 private:
 
-	void InitializePoly(physPolyShape *polyShape);
+	void InitializePoly(physPolyShape *polyShape, physPolyHandle worldPolygon);
 	void InitializeCircle(physCircleShape *circleShape);
 
-	void Refresh();
+	void ResetState();
 
 	void CalculateMassData();
 	void CalculateAABB();
+	void UpdateWorldPolygon();
+	void OnMoved();
 
+	uint32_t m_id;
 	bool m_static;
+	bool m_sleeping;
+	//	Seconds the body has been below the sleep velocities.
+	float m_sleepTime;
 	physShape *m_shape;
-	physAABB m_aabb;
-
-	physVec2 m_position;
-	physRot m_rotation;
+	physShape::Type m_shapeType;
+	physPolyHandle m_worldPolygon;
 
-	float m_angularVel;
-	float m_torque;
-	physVec2 m_linearVel;
-	physVec2 m_force;
+	physBodyStateChunk *m_state;
+	uint32_t m_slot;
 
-	float m_mass, m_invMass;
-	float m_I, m_invI;
+	float m_mass;
+	float m_I;
 
 	float m_density;
 	float m_restitution;
@@ -75,32 +118,38 @@ private:
 
 struct physBodyBufferSpan
 {
-    physBodyBufferSpan(physBody* first, uint32_t count)
+    physBodyBufferSpan(physBody* const* chunks, uint32_t count)
     {
-        this->array = first;
+        this->chunks = chunks;
         this->size = count;
     }
 
     uint32_t size;
-    physBody* array;
+    physBody* const* chunks;
 
     physBody & operator[](uint32_t idx) const
     {
-        return array[idx];
-    }
-
-    physBodyBufferSpan SubSpan(uint32_t fromIdx, uint32_t toIdx) const
-    {
-        return physBodyBufferSpan(&array[fromIdx], toIdx - fromIdx);
+        return chunks[idx >> BODY_CHUNK_SHIFT][idx & BODY_CHUNK_MASK];
     }
 };
 
 struct physBodyBuffer
 {
-    uint32_t count;
-    physBody bodies[MAX_BODIES];
+    physChunkedArray<physBody, BODY_CHUNK_SHIFT> bodies;
+    std::vector<std::unique_ptr<physBodyStateChunk>> states;
+
+    //  Returns a new body bound to its state slot, with the state at defaults.
+    physBody & Append();
 
+    uint32_t GetCount() const { return bodies.GetSize(); }
+    void Reserve(uint32_t capacity);
     void Reset();
-    void ResetHard();
-    physBodyBufferSpan AsSpan();
+    physBodyBufferSpan AsSpan() const;
+
+    uint32_t GetChunkCount() const { return (GetCount() + BODY_CHUNK_MASK) >> BODY_CHUNK_SHIFT; }
+    //  Bodies in use in the chunk.
+    uint32_t GetChunkSize(uint32_t chunkIdx) const
+    {
+        return std::min(GetCount() - (chunkIdx << BODY_CHUNK_SHIFT), BODY_CHUNK_SIZE);
+    }
 };
\ No newline at end of file
@@ -2,10 +2,39 @@
 #include "PhysicsSettings.h"
 #include "Benchmark.h"
 
-void NaiveNbyN(physBodyBufferSpan & bodies, physCollisionBuffer & collisions)
+#include "BroadPhaseUniformGrid.h"
+#include "BroadPhaseHierarchicalGrid.h"
+#include "BroadPhaseQuadTree.h"
+#include "BroadPhaseSweepAndPrune.h"
+#include "BroadPhaseDynamicTree.h"
+
+class BroadPhaseNaive : public physBroadPhase
+{
+public:
+    BroadPhaseNaive() :
+        m_bodies(nullptr, 0) {}
+
+    void SetBodies(physBodyBufferSpan & bodies) override
+    {
+        m_bodies = bodies;
+    }
+
+    void Solve(physCollisionBuffer & collisions) override
+    {
+        NaiveNbyN(m_bodies, collisions);
+    }
+
+private:
+    static void NaiveNbyN(physBodyBufferSpan & bodies, physCollisionBuffer & collisions);
+
+    physBodyBufferSpan m_bodies;
+};
+
+
+void BroadPhaseNaive::NaiveNbyN(physBodyBufferSpan & bodies, physCollisionBuffer & collisions)
 {
     unsigned long long testCount = 0;
-    for (uint32_t i = 0; i < bodies.size - 1; ++i)
+    for (uint32_t i = 0; i + 1 < bodies.size; ++i)
     {
         for (uint32_t j = i + 1; j < bodies.size; ++j)
         {
@@ -18,26 +47,46 @@ void NaiveNbyN(physBodyBufferSpan & bodies, physCollisionBuffer & collisions)
             ++testCount;
         }
     }
-    Benchmark::Get().RegisterValue("TestCount", testCount);
-}
-
-void UniformGrid(physBodyBufferSpan & bodies, physCollisionBuffer & collisions)
-{
-    static BroadPhaseUniformGrid bp(bodies, physVec2(0, 0), physVec2(800, 800));
-    bp.SetBodies(bodies);
-    bp.Solve(collisions);
+    PHYS_PROFILE_VALUE(TestCount, testCount);
 }
 
-void HierarchicalGrid(physBodyBufferSpan& bodies, physCollisionBuffer& collisions)
+std::unique_ptr<physBroadPhase> physBroadPhase::Create(Type type)
 {
-    static BroadPhaseHierarchicalGrid bp;
-    bp.SetBodies(bodies);
-    bp.Solve(collisions);
+    switch (type)
+    {
+    case bpNaive:
+        return std::make_unique<BroadPhaseNaive>();
+    case bpUniformFixed:
+    case bpUniformFlat:
+    case bpUniformOpenHash:
+    case bpUniformClosedHash:
+        return std::make_unique<BroadPhaseUniformGrid>(type, physVec2(0, 0), physVec2(800, 800));
+    case bpHierarchicalGrid:
+        return std::make_unique<BroadPhaseHierarchicalGrid>();
+    case bpQuadTree:
+        return std::make_unique<BroadPhaseQuadTree>(physVec2(400, 400), 400);
+    case bpSweepAndPrune:
+        return std::make_unique<BroadPhaseSweepAndPrune>();
+    case bpDynamicTree:
+        return std::make_unique<BroadPhaseDynamicTree>();
+    default:
+        return nullptr;
+    }
 }
 
-void QuadTree(physBodyBufferSpan& bodies, physCollisionBuffer& collisions)
+const char* physBroadPhase::GetName(Type type)
 {
-    static BroadPhaseQuadTree bp(physVec2(400, 400), 400);
-    bp.SetBodies(bodies);
-    bp.Solve(collisions);
+    switch (type)
+    {
+    case bpNaive:               return "Naive";
+    case bpUniformFixed:        return "Uniform grid (fixed)";
+    case bpUniformFlat:         return "Uniform grid (flat)";
+    case bpUniformOpenHash:     return "Uniform grid (open hashing)";
+    case bpUniformClosedHash:   return "Uniform grid (closed hashing)";
+    case bpHierarchicalGrid:    return "Hierarchical grid";
+    case bpQuadTree:            return "Quad tree";
+    case bpSweepAndPrune:       return "Sweep and prune";
+    case bpDynamicTree:         return "Dynamic tree";
+    default:                    return "Unknown";
+    }
 }
@@ -1,18 +1,215 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "PhysicsBody.h"
 #include "PhysicsCollision.h"
+#include "PhysicsSettings.h"
+#include "PhysicsThreadPool.h"
+#include "Benchmark.h"
+
+//  Number of tasks a parallel broad phase is split into. It does not depend on the number
+//  of threads, so the merged pair order is the same for any pool size.
+constexpr uint32_t BROAD_PHASE_TASK_COUNT = 64;
+
+//  Set of body index pairs kept between steps by the incremental broad phases. Pairs are found
+//  through an open-addressing table with tombstones, which only allocates when the pair count
+//  outgrows it. Keys hold the lower body index in the high half.
+class physPairSet
+{
+public:
+    //  Returns false if the pair was already in the set.
+    bool Add(uint32_t a, uint32_t b)
+    {
+        //  Tombstones count as used, so a table full of them is purged on the next rehash.
+        if ((m_usedSlots + 1) * 2 > m_table.size())
+            Rehash();
+
+        auto key = GetKey(a, b);
+        auto & slot = m_table[FindSlot(key)];
+        if (slot.key == key)
+            return false;
+        if (slot.key == EMPTY_KEY)
+            ++m_usedSlots;
+        slot = { key, uint32_t(m_pairs.size()) };
+        m_pairs.push_back(key);
+        return true;
+    }
+
+    //  Returns false if the pair was not in the set.
+    bool Remove(uint32_t a, uint32_t b)
+    {
+        if (m_table.empty())
+            return false;
+        auto key = GetKey(a, b);
+        auto & slot = m_table[FindSlot(key)];
+        if (slot.key != key)
+            return false;
+        RemoveAt(slot.index);
+        return true;
+    }
+
+    //  Removes every pair for which pred(first, second) holds, returns how many.
+    template<typename Pred>
+    uint32_t RemoveIf(Pred && pred)
+    {
+        uint32_t removed = 0;
+        for (uint32_t i = 0; i < m_pairs.size();)
+        {
+            if (pred(GetFirst(m_pairs[i]), GetSecond(m_pairs[i])))
+            {
+                RemoveAt(i);
+                ++removed;
+            }
+            else
+                ++i;
+        }
+        return removed;
+    }
+
+    void Clear()
+    {
+        m_pairs.clear();
+        std::fill(m_table.begin(), m_table.end(), Slot());
+        m_usedSlots = 0;
+    }
+
+    const std::vector<uint64_t> & GetPairs() const { return m_pairs; }
+    size_t GetSize() const { return m_pairs.size(); }
+
+    static uint32_t GetFirst(uint64_t key) { return uint32_t(key >> 32); }
+    static uint32_t GetSecond(uint64_t key) { return uint32_t(key); }
+
+private:
+    static uint64_t GetKey(uint32_t a, uint32_t b)
+    {
+        if (a > b)
+            std::swap(a, b);
+        return (uint64_t(a) << 32) | b;
+    }
+
+    //  Frees the slot of pair idx and moves the last pair into its place.
+    void RemoveAt(uint32_t idx)
+    {
+        m_table[FindSlot(m_pairs[idx])].key = TOMBSTONE_KEY;
+        if (idx != m_pairs.size() - 1)
+        {
+            m_pairs[idx] = m_pairs.back();
+            m_table[FindSlot(m_pairs[idx])].index = idx;
+        }
+        m_pairs.pop_back();
+    }
+
+    //  Slot holding key, otherwise the first free one on its probe sequence.
+    size_t FindSlot(uint64_t key) const
+    {
+        const size_t mask = m_table.size() - 1;
+        uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+        size_t index = size_t(hash ^ (hash >> 32)) & mask;
+        size_t freeSlot = SIZE_MAX;
+        while (m_table[index].key != EMPTY_KEY)
+        {
+            if (m_table[index].key == key)
+                return index;
+            if (m_table[index].key == TOMBSTONE_KEY && freeSlot == SIZE_MAX)
+                freeSlot = index;
+            index = (index + 1) & mask;
+        }
+        return freeSlot != SIZE_MAX ? freeSlot : index;
+    }
+
+    //  Drops tombstones, and doubles the table while pairs would fill more than a quarter of it.
+    void Rehash()
+    {
+        size_t tableSize = std::max<size_t>(m_table.size(), MIN_TABLE_SIZE);
+        while ((m_pairs.size() + 1) * 4 > tableSize)
+            tableSize <<= 1;
+
+        m_table.assign(tableSize, Slot());
+        for (uint32_t i = 0; i < m_pairs.size(); ++i)
+            m_table[FindSlot(m_pairs[i])] = { m_pairs[i], i };
+        m_usedSlots = m_pairs.size();
+    }
+
+    //  Bodies are below 2^31, so no pair can take the two marker keys.
+    static constexpr uint64_t EMPTY_KEY = UINT64_MAX;
+    static constexpr uint64_t TOMBSTONE_KEY = UINT64_MAX - 1;
+    static constexpr size_t MIN_TABLE_SIZE = 1024;
+
+    struct Slot
+    {
+        uint64_t key = EMPTY_KEY;
+        uint32_t index = 0;
+    };
+
+    std::vector<uint64_t> m_pairs;
+    std::vector<Slot> m_table;
+    size_t m_usedSlots = 0;
+};
+
+class physBroadPhase
+{
+public:
+    enum Type
+    {
+        bpNaive,
+        bpUniformFixed,
+        bpUniformFlat,
+        bpUniformOpenHash,
+        bpUniformClosedHash,
+        bpHierarchicalGrid,
+        bpQuadTree,
+        bpSweepAndPrune,
+        bpDynamicTree,
+        bpCount
+    };
+
+    virtual ~physBroadPhase() {}
+
+    //  Called every step before Solve. Incremental methods keep their state between calls
+    //  and rebuild when the body span changes.
+    virtual void SetBodies(physBodyBufferSpan & bodies) = 0;
+    virtual void Solve(physCollisionBuffer & collisions) = 0;
+
+    //  Methods that can split their work (flat grid, quad tree) use the pool when it is set.
+    void SetThreadPool(physThreadPool * threadPool) { m_threadPool = threadPool; }
 
-#include "BroadPhaseUniformGrid.h"
-#include "BroadPhaseHierarchicalGrid.h"
-#include "BroadPhaseQuadTree.h"
+    //  Length of the coming step, methods that predict motion (dynamic tree) scale velocities by it.
+    void SetTimeStep(float dt) { m_timeStep = dt; }
 
-//  TODO:   Make some abstract class to cover all methods.
+    static std::unique_ptr<physBroadPhase> Create(Type type);
+    static const char* GetName(Type type);
 
-void NaiveNbyN(physBodyBufferSpan & bodies, physCollisionBuffer & collisions);
+protected:
+    //  Runs task(taskIdx, pairList) for every task on the pool and appends the pair lists to
+    //  collisions in task order. Task returns its number of AABB tests, the sum is returned.
+    template<typename Task>
+    unsigned long long SolveParallel(uint32_t taskCount, physCollisionBuffer & collisions, Task && task)
+    {
+        m_taskPairs.resize(taskCount);
+        m_taskTests.assign(taskCount, 0);
+        m_threadPool->ParallelFor(taskCount, [&](uint32_t taskIdx, uint32_t)
+        {
+            PHYS_PROFILE_ZONE(BroadPhaseTask);
+            m_taskPairs[taskIdx].pairs.clear();
+            m_taskTests[taskIdx] = task(taskIdx, m_taskPairs[taskIdx]);
+        });
 
-void UniformGrid(physBodyBufferSpan & bodies, physCollisionBuffer & collisions);
+        unsigned long long testCount = 0;
+        for (uint32_t i = 0; i < taskCount; ++i)
+        {
+            collisions.AppendCollisions(m_taskPairs[i].pairs);
+            testCount += m_taskTests[i];
+        }
+        return testCount;
+    }
 
-void HierarchicalGrid(physBodyBufferSpan & bodies, physCollisionBuffer & collisions);
+    physThreadPool *m_threadPool = nullptr;
+    float m_timeStep = DT;
 
-void QuadTree(physBodyBufferSpan & bodies, physCollisionBuffer & collisions);
\ No newline at end of file
+private:
+    std::vector<physPairList> m_taskPairs;
+    std::vector<unsigned long long> m_taskTests;
+};
@@ -1,6 +1,8 @@
 #include "PhysicsCollision.h"
 #include "PhysicsBody.h"
 #include <vector>
+#include <algorithm>
+#include <cfloat>
 #include "Benchmark.h"
 
 bool physCollision::IsValid() const
@@ -8,144 +10,368 @@ bool physCollision::IsValid() const
     return A != nullptr && B != nullptr;
 }
 
+bool physCollision::IsAsleep() const
+{
+	return !A->IsAwake() && !B->IsAwake();
+}
+
+uint64_t physCollision::GetKey() const
+{
+	return (uint64_t(A->GetId()) << 32) | B->GetId();
+}
+
 void physCollision::Initialize()
 {
 	if (!IsValid())
 		return;
 	if (A->IsStatic() && B->IsStatic())
 		return;
-	
-	restitution = std::min(A->GetRestitution(), B->GetRestitution());
-	staticFriction = sqrtf(A->GetStaticFriction() * B->GetStaticFriction());
-	dynamicFriction = sqrtf(A->GetDynamicFriction() * B->GetDynamicFriction());
-}
 
-void physCollision::Solve() const
-{
-	if (A->IsStatic() && B->IsStatic())
-		return;
+	restitution = cache->restitution;
+	staticFriction = cache->staticFriction;
+	dynamicFriction = cache->dynamicFriction;
+
+	tangent = normal.cross(1.0f);
 
-	physVec2 impulse;
-	physVec2 tanImpulse;
 	for (int i = 0; i < contactCnt; ++i)
 	{
-		physVec2 radA = contacts[i] - A->GetPos();
-		physVec2 radB = contacts[i] - B->GetPos();
+		auto &contact = contacts[i];
+		physVec2 radA = contact.position - A->GetPos();
+		physVec2 radB = contact.position - B->GetPos();
 
 		physVec2 relativeVel =	B->GetLinearVelocity() + radB.cross(-B->GetAngularVelocity()) -
 								A->GetLinearVelocity() - radA.cross(-A->GetAngularVelocity());
 		float contactVel = relativeVel.dot(normal);
-		if (contactVel > 0)
-			return;
+
+		bool persistent = false;
+		for (int j = 0; j < cache->contactCnt; ++j)
+		{
+			if (cache->features[j] == contact.feature)
+			{
+				contact.normalImpulse = cache->normalImpulses[j];
+				contact.tangentImpulse = cache->tangentImpulses[j];
+				persistent = true;
+				break;
+			}
+		}
 
 		float rAxN = radA.cross(normal);
 		float rBxN = radB.cross(normal);
-
 		float invMassSum = A->GetInvMass() + B->GetInvMass();
-		invMassSum += rAxN * rAxN * A->GetInvI();
-		invMassSum += rBxN * rBxN * B->GetInvI();
+		float normalMass = invMassSum + rAxN * rAxN * A->GetInvI() + rBxN * rBxN * B->GetInvI();
+		contact.normalMass = normalMass > 0 ? 1.f / normalMass : 0.f;
+
+		float rAxT = radA.cross(tangent);
+		float rBxT = radB.cross(tangent);
+		float tangentMass = invMassSum + rAxT * rAxT * A->GetInvI() + rBxT * rBxT * B->GetInvI();
+		contact.tangentMass = tangentMass > 0 ? 1.f / tangentMass : 0.f;
+
+		//	Only fresh contacts bounce, warm started impulses already carry the response of
+		//	persistent ones and re-adding restitution every step pumps energy into piles.
+		contact.velocityBias = (!persistent && contactVel < -RESTITUTION_VELOCITY_THRESHOLD) ? -restitution * contactVel : 0.f;
+		contact.appliedCorrection = 0;
+	}
+}
 
-		float j = -(1.0f + restitution) * contactVel;
-		j /= invMassSum;
-		j /= contactCnt;
+void physCollision::WarmStart() const
+{
+	if (A->IsStatic() && B->IsStatic())
+		return;
+
+	for (int i = 0; i < contactCnt; ++i)
+	{
+		auto &contact = contacts[i];
+		physVec2 radA = contact.position - A->GetPos();
+		physVec2 radB = contact.position - B->GetPos();
 
-		//if (impulse.lengthSquared() == 0)
-		impulse = normal * j;
+		physVec2 impulse = normal * contact.normalImpulse + tangent * contact.tangentImpulse;
 		A->ApplyImpulse(-impulse, radA);
 		B->ApplyImpulse(impulse, radB);
+	}
+}
 
-		//	TODO: frictions
-
-		physVec2 t = relativeVel - (normal * relativeVel.dot(normal));
-		t.normalize();
+void physCollision::Solve()
+{
+	if (A->IsStatic() && B->IsStatic())
+		return;
 
-		float jt = relativeVel.dot(t);
-		jt /= invMassSum;
-		jt /= contactCnt;
+	for (int i = 0; i < contactCnt; ++i)
+	{
+		auto &contact = contacts[i];
+		physVec2 radA = contact.position - A->GetPos();
+		physVec2 radB = contact.position - B->GetPos();
 
-		if (abs(jt) < 0.001)
-			return;
+		//	Friction first, so the normal constraint has the final word.
+		physVec2 relativeVel =	B->GetLinearVelocity() + radB.cross(-B->GetAngularVelocity()) -
+								A->GetLinearVelocity() - radA.cross(-A->GetAngularVelocity());
 
-		if (tanImpulse.lengthSquared() == 0)
+		float jt = -relativeVel.dot(tangent) * contact.tangentMass;
+		float newTanImpulse = contact.tangentImpulse + jt;
+		float maxStatic = staticFriction * contact.normalImpulse;
+		if (abs(newTanImpulse) > maxStatic)
 		{
-			if (abs(jt) < abs(j * staticFriction))
-				tanImpulse = t * -jt;
-			else
-				tanImpulse = t * -j * dynamicFriction;
+			float maxDynamic = dynamicFriction * contact.normalImpulse;
+			newTanImpulse = std::max(-maxDynamic, std::min(newTanImpulse, maxDynamic));
 		}
+		jt = newTanImpulse - contact.tangentImpulse;
+		contact.tangentImpulse = newTanImpulse;
 
+		physVec2 tanImpulse = tangent * jt;
 		A->ApplyImpulse(-tanImpulse, radA);
 		B->ApplyImpulse(tanImpulse, radB);
+
+		relativeVel =	B->GetLinearVelocity() + radB.cross(-B->GetAngularVelocity()) -
+						A->GetLinearVelocity() - radA.cross(-A->GetAngularVelocity());
+
+		float j = (-relativeVel.dot(normal) + contact.velocityBias) * contact.normalMass;
+		float newImpulse = std::max(contact.normalImpulse + j, 0.f);
+		j = newImpulse - contact.normalImpulse;
+		contact.normalImpulse = newImpulse;
+
+		physVec2 impulse = normal * j;
+		A->ApplyImpulse(-impulse, radA);
+		B->ApplyImpulse(impulse, radB);
 	}
 }
 
-void physCollision::PositionalCorrection() const
+void physCollision::PositionalCorrection()
 {
 	if (A->IsStatic() && B->IsStatic())
 		return;
 
+	//	Applied per contact point, so the angular part straightens out tilted resting contacts.
+	//	Further position iterations work on what is left of the penetration measured by the
+	//	narrow phase, each removing the same fraction of it.
 	constexpr float k = 0.01f;
-	constexpr float p = 0.1f;
-	float coeff = std::max(penetration - k, 0.f) / (A->GetInvMass() + B->GetInvMass());
-	if (coeff == 0)
-		return;
-	physVec2 corr = -normal * coeff * p;
-	if (!A->IsStatic())
-		A->SetPosition(A->GetPos() + (corr * A->GetInvMass()));
-	if (!B->IsStatic())
-		B->SetPosition(B->GetPos() - (corr * B->GetInvMass()));
+	constexpr float p = 0.2f;
+	for (int i = 0; i < contactCnt; ++i)
+	{
+		auto &contact = contacts[i];
+		float correction = std::max(contact.penetration - contact.appliedCorrection - k, 0.f) * p;
+		if (correction == 0)
+			continue;
+		contact.appliedCorrection += correction;
+
+		physVec2 radA = contact.position - A->GetPos();
+		physVec2 radB = contact.position - B->GetPos();
+		float rAxN = radA.cross(normal);
+		float rBxN = radB.cross(normal);
+		float mass = A->GetInvMass() + B->GetInvMass() + rAxN * rAxN * A->GetInvI() + rBxN * rBxN * B->GetInvI();
+		if (mass == 0)
+			continue;
+
+		physVec2 corr = normal * (correction / mass);
+		if (!A->IsStatic())
+		{
+			A->SetPosition(A->GetPos() - (corr * A->GetInvMass()));
+			A->SetRotation(A->GetRot().angle() - radA.cross(corr) * A->GetInvI());
+		}
+		if (!B->IsStatic())
+		{
+			B->SetPosition(B->GetPos() + (corr * B->GetInvMass()));
+			B->SetRotation(B->GetRot().angle() + radB.cross(corr) * B->GetInvI());
+		}
+	}
+}
+
+void physCollisionBuffer::Reserve(uint32_t capacity)
+{
+    rawCollisions.reserve(capacity);
+    filteredCollisions.reserve(capacity);
 }
 
 void physCollisionBuffer::FilterCollisions()
 {
-    for(int i = 0; i < rawCount; ++i)
+    //  Table is kept at least twice as large as the number of raw pairs (power of two),
+    //  it only grows, and stale slots are invalidated by bumping the stamp.
+    size_t tableSize = 16;
+    while (tableSize < rawCollisions.size() * 2)
+        tableSize <<= 1;
+    if (m_filterTable.size() < tableSize || m_filterStamp == UINT32_MAX)
     {
-        physCollision & rawCollision = rawCollisions[i];
-        constexpr uint32_t primeNumberA = 1231872409;
-        constexpr uint32_t primeNumberB = 3116752669;
-        uint32_t index = (primeNumberA * uint32_t(rawCollision.A) + 
-                          primeNumberB * uint32_t(rawCollision.B)) % MAX_COLLISIONS;
-
-        while (filteredCollisions[index].IsValid() && filteredCollisions[index] != rawCollision)
-            index = (index + 1) % MAX_COLLISIONS;
+        m_filterTable.assign(std::max(tableSize, m_filterTable.size()), FilterSlot());
+        m_filterStamp = 0;
+    }
+    ++m_filterStamp;
 
-        if (filteredCollisions[index] == rawCollision)
+    const size_t mask = m_filterTable.size() - 1;
+    for (auto& rawCollision : rawCollisions)
+    {
+        constexpr uint64_t primeNumberA = 1231872409;
+        constexpr uint64_t primeNumberB = 3116752669;
+        uint64_t hash = primeNumberA * rawCollision.A->GetId() + primeNumberB * rawCollision.B->GetId();
+        size_t index = size_t(hash ^ (hash >> 29)) & mask;
+
+        bool duplicate = false;
+        while (m_filterTable[index].stamp == m_filterStamp)
+        {
+            if (filteredCollisions[m_filterTable[index].index] == rawCollision)
+            {
+                duplicate = true;
+                break;
+            }
+            index = (index + 1) & mask;
+        }
+        if (duplicate)
             continue;
 
-        filteredCollisions[index] = rawCollision;
-        ++filteredCount;
+        m_filterTable[index].stamp = m_filterStamp;
+        m_filterTable[index].index = uint32_t(filteredCollisions.size());
+        filteredCollisions.push_back(rawCollision);
     }
 }
 
-void physCollisionBuffer::ResolveAll()
+void physCollisionBuffer::SortByBodyIds()
+{
+    //  Keys are unique, filtering removed duplicate pairs and A is always the lower id.
+    m_sortKeys.resize(filteredCollisions.size());
+    for (uint32_t i = 0; i < filteredCollisions.size(); ++i)
+        m_sortKeys[i] = { filteredCollisions[i].GetKey(), i };
+    std::sort(m_sortKeys.begin(), m_sortKeys.end());
+
+    m_sorted.clear();
+    for (auto & key : m_sortKeys)
+        m_sorted.push_back(filteredCollisions[key.second]);
+    filteredCollisions.swap(m_sorted);
+}
+
+void physCollision::StoreImpulses() const
+{
+	cache->contactCnt = contactCnt;
+	for (int i = 0; i < contactCnt; ++i)
+	{
+		cache->features[i] = contacts[i].feature;
+		cache->normalImpulses[i] = contacts[i].normalImpulse;
+		cache->tangentImpulses[i] = contacts[i].tangentImpulse;
+	}
+}
+
+physManifoldCacheEntry * physContactCache::Acquire(const physCollision & col)
+{
+	//	Kept at most half full, growing only rehashes the keys, entries stay where they are.
+	if ((m_live.size() + 1) * 2 > m_table.size())
+		Rehash(std::max<size_t>(CONTACT_CACHE_MIN_TABLE, m_table.size() * 2));
+
+	uint64_t key = col.GetKey();
+	size_t index = FindSlot(key);
+	if (m_table[index].entry)
+	{
+		m_table[index].entry->stamp = m_stamp;
+		return m_table[index].entry;
+	}
+
+	physManifoldCacheEntry *entry = Allocate();
+	*entry = physManifoldCacheEntry();
+	entry->restitution = std::min(col.A->GetRestitution(), col.B->GetRestitution());
+	entry->staticFriction = sqrtf(col.A->GetStaticFriction() * col.B->GetStaticFriction());
+	entry->dynamicFriction = sqrtf(col.A->GetDynamicFriction() * col.B->GetDynamicFriction());
+	entry->stamp = m_stamp;
+	m_table[index] = { key, entry };
+	m_live.push_back({ key, entry });
+	return entry;
+}
+
+void physContactCache::EndStep()
+{
+	size_t kept = 0;
+	for (auto &live : m_live)
+	{
+		if (live.entry->stamp == m_stamp)
+			m_live[kept++] = live;
+		else
+			m_free.push_back(live.entry);
+	}
+	m_live.resize(kept);
+	Rehash(m_table.size());
+	++m_stamp;
+}
+
+void physContactCache::Clear()
 {
+	for (auto &live : m_live)
+		m_free.push_back(live.entry);
+	m_live.clear();
+	std::fill(m_table.begin(), m_table.end(), Slot());
+	m_stamp = 1;
+}
 
-    for (uint32_t i = 0; i < MAX_COLLISIONS; ++i)
+physManifoldCacheEntry * physContactCache::Allocate()
+{
+	if (m_free.empty())
+	{
+		m_blocks.push_back(std::make_unique<physManifoldCacheEntry[]>(CONTACT_CACHE_BLOCK_SIZE));
+		for (uint32_t i = CONTACT_CACHE_BLOCK_SIZE; i > 0; --i)
+			m_free.push_back(&m_blocks.back()[i - 1]);
+	}
+	physManifoldCacheEntry *entry = m_free.back();
+	m_free.pop_back();
+	return entry;
+}
+
+void physContactCache::Rehash(size_t tableSize)
+{
+	m_table.assign(tableSize, Slot());
+	for (auto &live : m_live)
+		m_table[FindSlot(live.key)] = live;
+}
+
+size_t physContactCache::FindSlot(uint64_t key) const
+{
+	//	Linear probing from a multiplicative hash, ends on the key or the first empty slot.
+	const size_t mask = m_table.size() - 1;
+	uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+	size_t index = size_t(hash ^ (hash >> 32)) & mask;
+	while (m_table[index].entry && m_table[index].key != key)
+		index = (index + 1) & mask;
+	return index;
+}
+
+void physCollisionBuffer::ResolveAll()
+{
+    //  A separated pair must not warm start from its old contacts once it touches again.
+    //  A sleeping one keeps them for when it wakes up. Done before any impulse is applied,
+    //  since those wake bodies and would make a skipped pair look separated.
+    for (auto& col : filteredCollisions)
+        if (col.contactCnt == 0 && col.cache && !col.IsAsleep())
+            col.cache->contactCnt = 0;
+
+    m_touching.clear();
+    for (auto& col : filteredCollisions)
     {
-        auto& col = filteredCollisions[i];
-        if (!col.IsValid())
+        if (col.contactCnt == 0)
             continue;
+        if (!col.cache)
+            col.cache = contactCache.Acquire(col);
         col.Initialize();
-        col.Solve();
-        col.PositionalCorrection();
+        col.WarmStart();
+        m_touching.push_back(&col);
     }
 
-    Benchmark::Get().RegisterValue("AllCollisions", rawCount);
-    Benchmark::Get().RegisterValue("UniqueCollisions", filteredCount);
+    solver.Solve(m_touching);
+
+    for (auto col : m_touching)
+        col->StoreImpulses();
+    contactCache.EndStep();
+
+    PHYS_PROFILE_VALUE(AllCollisions, GetRawCount());
+    PHYS_PROFILE_VALUE(UniqueCollisions, GetFilteredCount());
 }
 
 void physCollisionBuffer::Reset()
 {
-    for (uint32_t i = 0; i < MAX_COLLISIONS; ++i)
-        filteredCollisions[i] = physCollision();
-    rawCount = 0;
-    filteredCount = 0;
+    rawCollisions.clear();
+    filteredCollisions.clear();
+}
+
+void physCollisionBuffer::ClearCache()
+{
+    contactCache.Clear();
 }
 
 void CircleToCircle(physCollision * col, physBody * A, physBody * B)
 {
-	physCircleShape *As = dynamic_cast<physCircleShape*>(A->GetShape());
-	physCircleShape *Bs = dynamic_cast<physCircleShape*>(B->GetShape());
+	physCircleShape *As = static_cast<physCircleShape*>(A->GetShape());
+	physCircleShape *Bs = static_cast<physCircleShape*>(B->GetShape());
 
 	physVec2 normal = B->GetPos() - A->GetPos();
 	float distanceSqrd = normal.lengthSquared();
@@ -161,30 +387,29 @@ void CircleToCircle(physCollision * col, physBody * A, physBody * B)
 	{
 		col->penetration = As->GetRadius();
 		col->normal = physVec2(1, 0);
-		col->contacts[0] = A->GetPos();
+		col->contacts[0].position = A->GetPos();
+		col->contacts[0].penetration = col->penetration;
 	}
 	else
 	{
 		col->penetration = radSum - distance;
 		col->normal = normal / distance;
-		col->contacts[0] = col->normal * As->GetRadius() + A->GetPos();
+		col->contacts[0].position = col->normal * As->GetRadius() + A->GetPos();
+		col->contacts[0].penetration = col->penetration;
 	}
 }
 
 void CircleToPoly(physCollision * col, physBody * A, physBody * B)
 {
-	physCircleShape *As = dynamic_cast<physCircleShape*>(A->GetShape());
-	physPolyShape *Bs = dynamic_cast<physPolyShape*>(B->GetShape());
+	physCircleShape *As = static_cast<physCircleShape*>(A->GetShape());
 
 	float rad = As->GetRadius();
-	physRot polyRot = B->GetRot();
-	physVec2 center = A->GetPos() - B->GetPos();
-	center.rotate(-polyRot);
+	physVec2 center = A->GetPos();
 
 	float separation = -FLT_MAX;
 	int faceNormal = 0;
 
-	auto &ph = Bs->GetPolygon();
+	auto &ph = B->GetWorldPolygon();
 	for (uint32_t i = 0; i < ph.GetCount(); ++i)
 	{
 		float s = ph.At(i).normal.dot(center - ph.At(i).position);
@@ -205,17 +430,18 @@ void CircleToPoly(physCollision * col, physBody * A, physBody * B)
 	if (separation < 0.0001)
 	{
 		col->contactCnt = 1;
-		col->normal = ph.At(faceNormal).normal;
-		col->normal.rotate(polyRot);
-		col->normal = -col->normal;
-		col->contacts[0] = col->normal * rad + A->GetPos();
+		col->normal = -ph.At(faceNormal).normal;
+		col->contacts[0].position = col->normal * rad + A->GetPos();
+		col->contacts[0].feature = faceNormal;
 		col->penetration = rad;
+		col->contacts[0].penetration = rad;
 		return;
 	}
 
 	float d1 = (center - faceV1).dot(faceV2 - faceV1);
 	float d2 = (center - faceV2).dot(faceV1 - faceV2);
 	col->penetration = rad - separation;
+	col->contacts[0].penetration = col->penetration;
 
 	if (d1 <= 0.f)
 	{
@@ -223,12 +449,11 @@ void CircleToPoly(physCollision * col, physBody * A, physBody * B)
 			return;
 
 		physVec2 n = faceV1 - center;
-		n.rotate(polyRot);
 		n.normalize();
-		faceV1.rotate(polyRot);
 		col->contactCnt = 1;
 		col->normal = n;
-		col->contacts[0] = faceV1 + B->GetPos();
+		col->contacts[0].position = faceV1;
+		col->contacts[0].feature = FEATURE_VERTEX_FLAG | faceNormal;
 	}
 	else if (d2 <= 0.f)
 	{
@@ -236,22 +461,21 @@ void CircleToPoly(physCollision * col, physBody * A, physBody * B)
 			return;
 
 		physVec2 n = faceV2 - center;
-		n.rotate(polyRot);
 		n.normalize();
-		faceV2.rotate(polyRot);
 		col->contactCnt = 1;
 		col->normal = n;
-		col->contacts[0] = faceV2 + B->GetPos();
+		col->contacts[0].position = faceV2;
+		col->contacts[0].feature = FEATURE_VERTEX_FLAG | ((faceNormal + 1) % ph.GetCount());
 	}
 	else
 	{
 		physVec2 n = ph.At(faceNormal).normal;
 		if ((center - faceV1).dot(n) > rad)
 			return;
-		n.rotate(polyRot);
 		col->contactCnt = 1;
 		col->normal = -n;
-		col->contacts[0] = col->normal * rad + A->GetPos();
+		col->contacts[0].position = col->normal * rad + A->GetPos();
+		col->contacts[0].feature = faceNormal;
 	}
 }
 
@@ -263,24 +487,21 @@ void PolyToCircle(physCollision * col, physBody * A, physBody * B)
 
 static physVec2 gjkGetFarthestPntInDir(physBody * body, const physVec2 d)
 {
-	auto polyShape = dynamic_cast<physPolyShape*>(body->GetShape());
-	auto rot = body->GetRot();
-	auto &ph = polyShape->GetPolygon();
+	auto &ph = body->GetWorldPolygon();
+	auto vertices = ph.GetVertices();
 
-	physVec2 result;
-	float maxDot = -FLT_MIN;
-	for (uint32_t i = 0; i < ph.GetCount(); ++i)
+	physVec2 result = vertices[0].position;
+	float maxDot = result.dot(d);
+	for (uint32_t i = 1; i < ph.GetCount(); ++i)
 	{
-		physVec2 curVec = ph.At(i).position;
-		curVec.rotate(rot);
-		float curDot = curVec.dot(d);
+		float curDot = vertices[i].position.dot(d);
 		if(curDot > maxDot)
 		{
 			maxDot = curDot;
-			result = curVec;
+			result = vertices[i].position;
 		}
 	}
-	return result + body->GetPos();
+	return result;
 }
 
 static physVec2 gjkGetSupportPoint(physBody * b1, physBody * b2, const physVec2 d)
@@ -292,19 +513,23 @@ static physVec2 gjkGetSupportPoint(physBody * b1, physBody * b2, const physVec2
 	return minkowskiDifference;
 }
 
-static bool gjkSimplexContainsOrigin(std::vector<physVec2> &simplex, physVec2 &d)
+//	The GJK simplex becomes the initial EPA polytope, which grows by one vertex per iteration.
+constexpr uint32_t EPA_MAX_VERTICES = 64;
+typedef physFixedVector<physVec2, EPA_MAX_VERTICES> physPolytope;
+
+static bool gjkSimplexContainsOrigin(physPolytope &simplex, physVec2 &d)
 {
-	if (simplex.size() < 2)
+	if (simplex.GetSize() < 2)
 		return false;
 
-	physVec2 a = simplex.back();
+	physVec2 a = simplex.Back();
 	
 	physVec2 ao = -a;
 
-	if(simplex.size() == 3)
+	if(simplex.GetSize() == 3)
 	{
-		physVec2 b = simplex.at(1);
-		physVec2 c = simplex.at(0);
+		physVec2 b = simplex[1];
+		physVec2 c = simplex[0];
 
 		physVec2 ab = b - a;
 		physVec2 ac = c - a;
@@ -314,12 +539,12 @@ static bool gjkSimplexContainsOrigin(std::vector<physVec2> &simplex, physVec2 &d
 
 		if(abPerp.dot(ao) >= 0)
 		{
-			simplex.erase(simplex.begin());
+			simplex.Erase(0);
 			d = abPerp;
 		}
 		else if (acPerp.dot(ao) >= 0)
 		{
-			simplex.erase(simplex.begin() + 1);
+			simplex.Erase(1);
 			d = acPerp;
 		}
 		else
@@ -327,7 +552,7 @@ static bool gjkSimplexContainsOrigin(std::vector<physVec2> &simplex, physVec2 &d
 	}
 	else
 	{
-		physVec2 b = simplex.at(0);
+		physVec2 b = simplex[0];
 		physVec2 ab = b - a;
 		if (ab.dot(ao) >= 0)
 		{
@@ -340,19 +565,18 @@ static bool gjkSimplexContainsOrigin(std::vector<physVec2> &simplex, physVec2 &d
 	return false;
 }
 
-static void cpGetMostPerpendicularEdge(physBody *body, physVec2 normal, physVec2 &ve1, physVec2 &ve2, physVec2 &vMaxProj)
+static void cpGetMostPerpendicularEdge(physBody *body, physVec2 normal, physVec2 &ve1, physVec2 &ve2, physVec2 &vMaxProj, int &edgeIdx)
 {
-	auto polyShape = dynamic_cast<physPolyShape*>(body->GetShape());
-	auto rot = body->GetRot();
-	auto &ph = polyShape->GetPolygon();
+	//	Results are relative to the body position.
+	auto &ph = body->GetWorldPolygon();
+	auto pos = body->GetPos();
 
 	int idx = 0;
 	float maxProjection = -FLT_MAX;
 
 	for (uint32_t i = 0; i < ph.GetCount(); ++i)
 	{
-		physVec2 v = ph.At(i).position;
-		v.rotate(rot);
+		physVec2 v = ph.At(i).position - pos;
 		float projection = normal.dot(v);
 		if(maxProjection < projection)
 		{
@@ -362,14 +586,12 @@ static void cpGetMostPerpendicularEdge(physBody *body, physVec2 normal, physVec2
 	}
 	int idxNext = (idx + 1) % ph.GetCount();
 	int idxPrev = (idx - 1 < 0) ? ph.GetCount() - 1 : idx - 1;
-	physVec2 v = ph.At(idx).position;
-	physVec2 vNext = ph.At(idxNext).position;
-	physVec2 vPrev = ph.At(idxPrev).position;
+	physVec2 v = ph.At(idx).position - pos;
+	physVec2 vNext = ph.At(idxNext).position - pos;
+	physVec2 vPrev = ph.At(idxPrev).position - pos;
 
 	physVec2 left = v - vNext;
 	physVec2 right = v - vPrev;
-	left.rotate(rot);
-	right.rotate(rot);
 
 	left.normalize();
 	right.normalize();
@@ -378,28 +600,29 @@ static void cpGetMostPerpendicularEdge(physBody *body, physVec2 normal, physVec2
 	{
 		ve1 = vPrev;
 		ve2 = v;
+		edgeIdx = idxPrev;
 	}
 	else
 	{
 		ve1 = v;
 		ve2 = vNext;
+		edgeIdx = idx;
 	}
 
 	vMaxProj = v;
-	ve1.rotate(rot);
-	ve2.rotate(rot);
-	vMaxProj.rotate(rot);
 }
 
-static std::vector<physVec2> cpClip(physVec2 v1, physVec2 v2, physVec2 normal, float offset)
+//	Clipping a segment against a plane keeps at most two points.
+typedef physFixedVector<physVec2, 2> physClipPoints;
+
+static physClipPoints cpClip(physVec2 v1, physVec2 v2, physVec2 normal, float offset)
 {
-	std::vector<physVec2> result;
-    result.reserve(3);
+	physClipPoints result;
 	float d1 = normal.dot(v1) - offset;
 	float d2 = normal.dot(v2) - offset;
 
-	if (d1 >= 0) result.push_back(v1);
-	if (d2 >= 0) result.push_back(v2);
+	if (d1 >= 0) result.PushBack(v1);
+	if (d2 >= 0) result.PushBack(v2);
 
 	if(d1 * d2 < 0)
 	{
@@ -407,23 +630,158 @@ static std::vector<physVec2> cpClip(physVec2 v1, physVec2 v2, physVec2 normal, f
 
 		float u = d1 / (d1 - d2);
 		e = e * u + v1;
-		result.push_back(e);
+		result.PushBack(e);
 	}
 	return result;
 }
 
-void PolyToPoly(physCollision * col, physBody * A, physBody * B)
+//	World vertices and normals of one polygon of the pair.
+struct satPolygon
+{
+	explicit satPolygon(const physBody * body)
+		: vertices(body->GetWorldPolygon().GetVertices()), count(body->GetWorldPolygon().GetCount()) {}
+
+	const physVertex *vertices;
+	uint32_t count;
+};
+
+//	Distance of the deepest vertex of poly2 in front of the given edge of poly1, negative if
+//	the polygons overlap along its normal.
+static float satEdgeSeparation(const satPolygon &poly1, uint32_t edge, const satPolygon &poly2)
+{
+	physVec2 n = poly1.vertices[edge].normal;
+	physVec2 v = poly1.vertices[edge].position;
+	float separation = FLT_MAX;
+	for (uint32_t i = 0; i < poly2.count; ++i)
+		separation = std::min(separation, n.dot(poly2.vertices[i].position - v));
+	return separation;
+}
+
+static float satMaxSeparation(const satPolygon &poly1, const satPolygon &poly2, uint32_t &edge)
+{
+	float maxSeparation = -FLT_MAX;
+	for (uint32_t i = 0; i < poly1.count; ++i)
+	{
+		float separation = satEdgeSeparation(poly1, i, poly2);
+		if (separation > maxSeparation)
+		{
+			maxSeparation = separation;
+			edge = i;
+		}
+		//	Any separating axis will do.
+		if (separation > 0)
+			break;
+	}
+	return maxSeparation;
+}
+
+//	Clips the segment against the half plane normal.dot(p) >= offset in place, so both points
+//	keep their slot. Returns false if the whole segment is outside.
+static bool satClip(physVec2 (&points)[2], physVec2 normal, float offset)
+{
+	float d0 = normal.dot(points[0]) - offset;
+	float d1 = normal.dot(points[1]) - offset;
+	if (d0 < 0 && d1 < 0)
+		return false;
+
+	if (d0 * d1 < 0)
+	{
+		physVec2 e = points[0] + (points[1] - points[0]) * (d0 / (d0 - d1));
+		points[d0 < 0 ? 0 : 1] = e;
+	}
+	return true;
+}
+
+static void PolyToPolySAT(physCollision * col, physBody * A, physBody * B)
+{
+	satPolygon polyA(A), polyB(B);
+
+	//	The axis that separated the pair in the last step usually still does.
+	auto cache = col->cache;
+	if (cache && cache->separatingEdge >= 0)
+	{
+		uint32_t edge = uint32_t(cache->separatingEdge);
+		const satPolygon &poly1 = cache->separatingFlip ? polyB : polyA;
+		const satPolygon &poly2 = cache->separatingFlip ? polyA : polyB;
+		if (edge < poly1.count && satEdgeSeparation(poly1, edge, poly2) > 0)
+			return;
+	}
+
+	uint32_t edgeA = 0, edgeB = 0;
+	float separationA = satMaxSeparation(polyA, polyB, edgeA);
+	float separationB = separationA > 0 ? 0.f : satMaxSeparation(polyB, polyA, edgeB);
+	if (separationA > 0 || separationB > 0)
+	{
+		if (cache)
+		{
+			cache->separatingFlip = separationA <= 0;
+			cache->separatingEdge = int8_t(cache->separatingFlip ? edgeB : edgeA);
+		}
+		return;
+	}
+	if (cache)
+		cache->separatingEdge = -1;
+
+	//	Prefer the face of A unless B is clearly better, so resting pairs keep their reference face.
+	constexpr float relativeTolerance = 0.98f;
+	constexpr float absoluteTolerance = 0.001f;
+	bool flip = separationB > relativeTolerance * separationA + absoluteTolerance;
+	const satPolygon &ref = flip ? polyB : polyA;
+	const satPolygon &inc = flip ? polyA : polyB;
+	uint32_t refEdge = flip ? edgeB : edgeA;
+
+	physVec2 refNormal = ref.vertices[refEdge].normal;
+	uint32_t incEdge = 0;
+	float minDot = FLT_MAX;
+	for (uint32_t i = 0; i < inc.count; ++i)
+	{
+		float d = refNormal.dot(inc.vertices[i].normal);
+		if (d < minDot)
+		{
+			minDot = d;
+			incEdge = i;
+		}
+	}
+
+	physVec2 refV1 = ref.vertices[refEdge].position;
+	physVec2 refV2 = ref.vertices[(refEdge + 1) % ref.count].position;
+	physVec2 points[2] = { inc.vertices[incEdge].position, inc.vertices[(incEdge + 1) % inc.count].position };
+
+	physVec2 sideNormal = refV2 - refV1;
+	sideNormal.normalize();
+	if (!satClip(points, sideNormal, sideNormal.dot(refV1)))
+		return;
+	if (!satClip(points, -sideNormal, -sideNormal.dot(refV2)))
+		return;
+
+	col->normal = flip ? -refNormal : refNormal;
+	col->penetration = -std::max(separationA, separationB);
+	col->contactCnt = 0;
+	float offset = refNormal.dot(refV1);
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		float penetration = offset - refNormal.dot(points[i]);
+		if (penetration < 0.0f)
+			continue;
+		auto &contact = col->contacts[col->contactCnt++];
+		contact.position = points[i];
+		contact.penetration = penetration;
+		contact.feature = MakeFeatureId(uint8_t(refEdge), uint8_t(incEdge), i, flip);
+	}
+}
+
+static void PolyToPolyGJK(physCollision * col, physBody * A, physBody * B)
 {
 	//	GJK
-	std::vector<physVec2> simplex;
+	physPolytope simplex;
 	physVec2 dir = { 0, -1 };
 	physVec2 support = gjkGetSupportPoint(A, B, dir);
-	simplex.push_back(support);
+	simplex.PushBack(support);
 	dir = -support;
 	while (true)
 	{
 		physVec2 a = gjkGetSupportPoint(A, B, dir);
-		simplex.push_back(a);
+		simplex.PushBack(a);
 
 		if (a.dot(dir) <= 0)
 			return;
@@ -439,9 +797,9 @@ void PolyToPoly(physCollision * col, physBody * A, physBody * B)
 	while(true)
 	{
 		distance = FLT_MAX;
-		for (int i = 0; i < simplex.size(); ++i)
+		for (uint32_t i = 0; i < simplex.GetSize(); ++i)
 		{
-			int j = (i + 1) % simplex.size();
+			uint32_t j = (i + 1) % simplex.GetSize();
 
 			physVec2 ab = simplex[j] - simplex[i];
 			physVec2 n = tripleProduct(ab, simplex[i], ab);
@@ -458,21 +816,23 @@ void PolyToPoly(physCollision * col, physBody * A, physBody * B)
 
 		support = gjkGetSupportPoint(A, B, normal);
 		float d = support.dot(normal);
-		if (abs(d - distance) < 0.001)
+		//	A full polytope ends the search with the closest edge found so far.
+		if (abs(d - distance) < 0.001 || simplex.IsFull())
 		{
 			col->normal = normal;
 			col->penetration = d;
 			break;
 		}
 		
-		simplex.insert(simplex.begin() + closestIdx, support);
+		simplex.Insert(closestIdx, support);
 	}
 
 	//	CLIPPING
 	physVec2 relPos = B->GetPos() - A->GetPos();
 	physVec2 eAv1, eAv2, eBv1, eBv2, eRmax, eImax;
-	cpGetMostPerpendicularEdge(A, normal, eAv1, eAv2, eRmax);
-	cpGetMostPerpendicularEdge(B, -normal, eBv1, eBv2, eImax);
+	int eAIdx, eBIdx;
+	cpGetMostPerpendicularEdge(A, normal, eAv1, eAv2, eRmax, eAIdx);
+	cpGetMostPerpendicularEdge(B, -normal, eBv1, eBv2, eImax, eBIdx);
 	physVec2 eA = eAv2 - eAv1;
 	eBv1 += relPos;
 	eBv2 += relPos;
@@ -499,31 +859,73 @@ void PolyToPoly(physCollision * col, physBody * A, physBody * B)
 		flip = true;
 	}
 	ref.normalize();
-	std::vector<physVec2> cp;
 
 	float offset1 = ref.dot(eRv1);
-	cp = cpClip(eIv1, eIv2, ref, offset1);
-	if (cp.size() < 2) return;
+	physClipPoints cp = cpClip(eIv1, eIv2, ref, offset1);
+	if (cp.GetSize() < 2) return;
 
 	float offset2 = ref.dot(eRv2);
 	cp = cpClip(cp[0], cp[1], -ref, -offset2);
-	if (cp.size() < 2) return;
+	if (cp.GetSize() < 2) return;
 
 	physVec2 refNorm = -ref.cross(1.0f);
-	float max = refNorm.dot(eRmax);
+	float max = refNorm.dot(flip ? eImax + relPos : eRmax);
+	uint8_t clipIds[2] = { 0, 1 };
 	int delIdx = 1;
 	if (refNorm.dot(cp[0]) - max < 0.0f)
 	{
-		cp.erase(cp.begin());
+		cp.Erase(0);
+		clipIds[0] = clipIds[1];
 		delIdx = 0;
 	}
 	if (refNorm.dot(cp[delIdx]) - max < 0.0f)
-		cp.erase(cp.begin() + delIdx);
+		cp.Erase(delIdx);
 
-	for (int i = 0; i < cp.size(); i++)
+	//	Reference face normal is more stable between steps than the EPA direction.
+	col->normal = flip ? refNorm : -refNorm;
+
+	uint8_t refIdx = uint8_t(flip ? eBIdx : eAIdx);
+	uint8_t incIdx = uint8_t(flip ? eAIdx : eBIdx);
+	for (uint32_t i = 0; i < cp.GetSize(); i++)
 	{
 		col->contactCnt = i + 1;
-		col->contacts[i] = cp.at(i) + A->GetPos();
+		col->contacts[i].position = cp[i] + A->GetPos();
+		col->contacts[i].penetration = refNorm.dot(cp[i]) - max;
+		col->contacts[i].feature = MakeFeatureId(refIdx, incIdx, clipIds[i], flip);
 	}
 	
-}
\ No newline at end of file
+}
+
+void PolyToPoly(physCollision * col, physBody * A, physBody * B)
+{
+	auto &phA = A->GetWorldPolygon();
+	auto &phB = B->GetWorldPolygon();
+	if (phA.GetCount() <= SAT_MAX_VERTICES && phB.GetCount() <= SAT_MAX_VERTICES)
+		PolyToPolySAT(col, A, B);
+	else
+		PolyToPolyGJK(col, A, B);
+}
+
+const physCollideFn COLLIDE_FUNCTIONS[physShape::sCount][physShape::sCount] =
+{
+	{ CircleToCircle, CircleToPoly },
+	{ PolyToCircle, PolyToPoly }
+};
+
+uint32_t EstimateCollideCost(const physBody * A, const physBody * B)
+{
+	//	Measured ratios: a circle against a polygon walks its vertices once, separating axes
+	//	visit every vertex of both polygons about once with a cached axis, GJK and EPA twice.
+	bool polyA = A->GetShapeType() == physShape::sPoly;
+	bool polyB = B->GetShapeType() == physShape::sPoly;
+	if (!polyA && !polyB)
+		return 1;
+	if (!polyA || !polyB)
+		return 1 + (polyA ? A : B)->GetWorldPolygon().GetCount() / 4;
+
+	uint32_t countA = A->GetWorldPolygon().GetCount();
+	uint32_t countB = B->GetWorldPolygon().GetCount();
+	if (countA <= SAT_MAX_VERTICES && countB <= SAT_MAX_VERTICES)
+		return countA + countB;
+	return 2 * (countA + countB);
+}
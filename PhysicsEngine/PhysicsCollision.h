@@ -1,20 +1,67 @@
 #pragma once
+#include <vector>
+#include <cstdint>
+#include <memory>
 #include "PhysicsShape.h"
+#include "PhysicsBody.h"
 #include "PhysicsSettings.h"
+#include "PhysicsSolver.h"
 
-class physBody;
+//  Identifies which features of both shapes produced a contact point, so the
+//  same contact can be recognised in the next step.
+constexpr uint32_t FEATURE_VERTEX_FLAG = 0x10000;
+
+inline uint32_t MakeFeatureId(uint8_t referenceEdge, uint8_t incidentEdge, uint8_t clipIdx, bool flip)
+{
+	return (uint32_t(flip) << 24) | (uint32_t(referenceEdge) << 16) | (uint32_t(incidentEdge) << 8) | clipIdx;
+}
+
+struct physContact
+{
+	physVec2 position;
+	float penetration = 0;
+	uint32_t feature = 0;
+
+	float normalImpulse = 0;
+	float tangentImpulse = 0;
+	float normalMass = 0;
+	float tangentMass = 0;
+	float velocityBias = 0;
+	//	Penetration already removed by earlier position iterations of this step.
+	float appliedCorrection = 0;
+};
+
+//  Data kept for a body pair between steps.
+struct physManifoldCacheEntry
+{
+	uint32_t stamp = 0;
+	int contactCnt = 0;
+	uint32_t features[2] = { 0 };
+	float normalImpulses[2] = { 0 };
+	float tangentImpulses[2] = { 0 };
+
+	float restitution = 0;
+	float staticFriction = 0;
+	float dynamicFriction = 0;
+
+	//	Edge that separated a polygon pair in the last step, of B if flipped, -1 if none.
+	int8_t separatingEdge = -1;
+	bool separatingFlip = false;
+};
 
 struct physCollision
 {
 	physBody *A;
 	physBody *B;
 	physVec2 normal;
-	physVec2 contacts[2];
+	physVec2 tangent;
+	physContact contacts[2];
 	float penetration;
 	int contactCnt;
 	float restitution;
 	float staticFriction;
 	float dynamicFriction;
+	physManifoldCacheEntry *cache;
 
 	physCollision()
 	{
@@ -26,11 +73,14 @@ struct physCollision
 		restitution = 0;
 		staticFriction = 0;
 		dynamicFriction = 0;
+		cache = nullptr;
 	}
 
+	//	A is the body with the lower id, so a pair and its manifold do not depend on where the
+	//	bodies were allocated.
 	physCollision(physBody *A, physBody *B)
 	{
-		if (A > B)
+		if (A->GetId() > B->GetId())
 		{
 			this->A = B;
 			this->B = A;
@@ -46,6 +96,7 @@ struct physCollision
 		restitution = 0;
 		staticFriction = 0;
 		dynamicFriction = 0;
+		cache = nullptr;
 	}
 
     bool operator==(const physCollision & rhs) const
@@ -59,33 +110,117 @@ struct physCollision
     }
 
     bool IsValid() const;
+	//	Neither body is awake, the narrow phase and the solver skip the pair.
+	bool IsAsleep() const;
+	uint64_t GetKey() const;
 	void Initialize();
-	void Solve() const;
-	void PositionalCorrection() const;
+	void WarmStart() const;
+	void Solve();
+	void PositionalCorrection();
+	void StoreImpulses() const;
 };
 
-struct physCollisionBuffer
+//  Persistent pair cache keyed by body ids. Entries not touched during a step are dropped
+//  at its end. Entries live in fixed blocks and are recycled through a free list, so they
+//  never move and a steady state allocates nothing. Keys are found through an open-addressing
+//  table that EndStep rebuilds from the surviving entries, so removal needs no tombstones.
+class physContactCache
 {
-    uint32_t rawCount;
-    physCollision rawCollisions[MAX_COLLISIONS];
+public:
+	physManifoldCacheEntry *Acquire(const physCollision &col);
+	void EndStep();
+	void Clear();
+
+	size_t GetSize() const { return m_live.size(); }
+
+private:
+	//	Key of a pair and its entry, empty table slots have no entry.
+	struct Slot
+	{
+		uint64_t key = 0;
+		physManifoldCacheEntry *entry = nullptr;
+	};
 
-    uint32_t filteredCount;
-    physCollision filteredCollisions[MAX_COLLISIONS];
+	physManifoldCacheEntry *Allocate();
+	void Rehash(size_t tableSize);
+	size_t FindSlot(uint64_t key) const;
+
+	std::vector<std::unique_ptr<physManifoldCacheEntry[]>> m_blocks;
+	std::vector<physManifoldCacheEntry*> m_free;
+	std::vector<Slot> m_live;
+	std::vector<Slot> m_table;
+	uint32_t m_stamp = 1;
+};
+
+struct physCollisionBuffer
+{
+    std::vector<physCollision> rawCollisions;
+    std::vector<physCollision> filteredCollisions;
 
     void AppendCollision(physBody * a, physBody * b)
     {
-        if (rawCount >= MAX_COLLISIONS)
-            return;
-
-        rawCollisions[rawCount] = physCollision(a, b);
-        ++rawCount;
+        rawCollisions.emplace_back(a, b);
+    }
+    void AppendCollisions(const std::vector<physCollision> & collisions)
+    {
+        rawCollisions.insert(rawCollisions.end(), collisions.begin(), collisions.end());
     }
+    uint32_t GetRawCount() const { return uint32_t(rawCollisions.size()); }
+    uint32_t GetFilteredCount() const { return uint32_t(filteredCollisions.size()); }
+
+    void Reserve(uint32_t capacity);
     void FilterCollisions();
+    //  Orders the filtered pairs by the ids of their bodies, which makes everything after the
+    //  broad phase independent of the order it reported pairs in.
+    void SortByBodyIds();
     void ResolveAll();
     void Reset();
+    void ClearCache();
+
+    physContactCache contactCache;
+    physContactSolver solver;
+
+private:
+    //  Slot of the dedup table used by FilterCollisions. A slot is occupied only
+    //  if its stamp matches the current one, so the table never has to be cleared.
+    struct FilterSlot
+    {
+        uint32_t stamp = 0;
+        uint32_t index = 0;
+    };
+
+    std::vector<FilterSlot> m_filterTable;
+    uint32_t m_filterStamp = 0;
+
+    std::vector<physCollision*> m_touching;
+
+    std::vector<std::pair<uint64_t, uint32_t>> m_sortKeys;
+    std::vector<physCollision> m_sorted;
 };
 
+//  Pair output of one parallel broad phase task. Lists are merged into the shared buffer
+//  in task order, so the result does not depend on which thread ran which task.
+struct physPairList
+{
+    std::vector<physCollision> pairs;
+
+    void AppendCollision(physBody * a, physBody * b)
+    {
+        pairs.emplace_back(a, b);
+    }
+};
+
+typedef void (*physCollideFn)(physCollision *col, physBody *A, physBody *B);
+
+//	Narrow phase test of every shape type combination, indexed by the types of A and B.
+extern const physCollideFn COLLIDE_FUNCTIONS[physShape::sCount][physShape::sCount];
+
+//	Rough cost of the narrow phase test of A and B in circle-circle tests, for balancing work.
+uint32_t EstimateCollideCost(const physBody *A, const physBody *B);
+
 void CircleToCircle(physCollision *col, physBody *A, physBody *B);
 void CircleToPoly(physCollision *col, physBody *A, physBody *B);
 void PolyToCircle(physCollision *col, physBody *A, physBody *B);
+//	Polygons with up to SAT_MAX_VERTICES vertices each are tested with separating axes, which
+//	also reuses the axis cached in col->cache if set. Larger ones go through GJK and EPA.
 void PolyToPoly(physCollision *col, physBody *A, physBody *B);
\ No newline at end of file
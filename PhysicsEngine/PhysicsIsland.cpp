@@ -0,0 +1,44 @@
+#include "PhysicsIsland.h"
+
+#include <utility>
+
+void physIslandSet::Reset(uint32_t count)
+{
+    m_parent.clear();
+    m_size.clear();
+    Grow(count);
+}
+
+void physIslandSet::Grow(uint32_t count)
+{
+    for (uint32_t i = GetCount(); i < count; ++i)
+    {
+        m_parent.push_back(i);
+        m_size.push_back(1);
+    }
+}
+
+void physIslandSet::Link(uint32_t a, uint32_t b)
+{
+    a = Find(a);
+    b = Find(b);
+    if (a == b)
+        return;
+
+    //  Smaller tree under the larger one keeps paths short.
+    if (m_size[a] < m_size[b])
+        std::swap(a, b);
+    m_parent[b] = a;
+    m_size[a] += m_size[b];
+}
+
+uint32_t physIslandSet::Find(uint32_t idx)
+{
+    //  Path halving, every visited node skips to its grandparent.
+    while (m_parent[idx] != idx)
+    {
+        m_parent[idx] = m_parent[m_parent[idx]];
+        idx = m_parent[idx];
+    }
+    return idx;
+}
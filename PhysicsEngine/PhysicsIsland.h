@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+//  Union-find over body indices. The contact solver links every pair of dynamic bodies in
+//  contact to find pairs it can solve on separate threads. The world then adds the pairs of
+//  sleeping bodies, so bodies sharing a root form an island that sleeps and wakes as a whole.
+//  Static bodies are never linked, a floor does not merge everything that rests on it.
+
+class physIslandSet
+{
+public:
+    //  Every index in [0, count) becomes its own island.
+    void Reset(uint32_t count);
+    //  Indices from GetCount() up to count become islands of their own.
+    void Grow(uint32_t count);
+
+    void Link(uint32_t a, uint32_t b);
+    uint32_t Find(uint32_t idx);
+
+    uint32_t GetCount() const { return uint32_t(m_parent.size()); }
+
+private:
+    std::vector<uint32_t> m_parent;
+    std::vector<uint32_t> m_size;
+};
@@ -0,0 +1,238 @@
+#include "PhysicsKernels.h"
+
+#if PHYS_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#if PHYS_SIMD_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+//  MSVC compiles AVX intrinsics without /arch:AVX2.
+#define PHYS_TARGET_AVX2
+#else
+#define PHYS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+    void IntegrateVelocitiesScalar(physVec2 *linearVel, float *angularVel, const physVec2 *force, const float *torque,
+                                   const float *invMass, const float *invI, const float *gravityScale,
+                                   physVec2 gravity, float halfDt, uint32_t first, uint32_t count)
+    {
+        for (uint32_t i = first; i < count; ++i)
+        {
+            linearVel[i] += (force[i] * invMass[i] + gravity * gravityScale[i]) * halfDt;
+            angularVel[i] += torque[i] * invI[i] * halfDt;
+        }
+    }
+
+    void IntegratePositionsScalar(physVec2 *position, const physVec2 *linearVel, float dt, uint32_t first, uint32_t count)
+    {
+        for (uint32_t i = first; i < count; ++i)
+            position[i] += linearVel[i] * dt;
+    }
+
+    void ComputeCircleAABBsScalar(physAABB *aabb, const physVec2 *position, const float *radius, uint32_t first, uint32_t count)
+    {
+        for (uint32_t i = first; i < count; ++i)
+        {
+            physVec2 extent(radius[i], radius[i]);
+            aabb[i] = physAABB(position[i] - extent, position[i] + extent);
+        }
+    }
+
+#if PHYS_SIMD_SSE2
+    //  (a0, a1) -> (a0, a0, a1, a1), one value per vector component.
+    inline __m128 LoadPairSpread(const float *values)
+    {
+        __m128 pair = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(values)));
+        return _mm_unpacklo_ps(pair, pair);
+    }
+#endif
+
+#if PHYS_SIMD_AVX2
+    bool DetectAvx2()
+    {
+#if defined(__AVX2__)
+        return true;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        //  The OS has to save the YMM registers: OSXSAVE, then SSE and AVX state enabled in XCR0.
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }
+
+    const bool s_hasAvx2 = DetectAvx2();
+
+    //  (a0, a1, a2, a3) -> (a0, a0, a1, a1, a2, a2, a3, a3)
+    PHYS_TARGET_AVX2 inline __m256 LoadQuadSpread(const float *values)
+    {
+        const __m256i spread = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+        return _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(values)), spread);
+    }
+
+    //  The AVX2 kernels clear the upper halves of the YMM registers before the scalar tail, so
+    //  SSE code compiled without VEX encoding runs after them without a transition penalty.
+    PHYS_TARGET_AVX2 void IntegrateVelocitiesAvx2(physVec2 *linearVel, float *angularVel, const physVec2 *force, const float *torque,
+                                                  const float *invMass, const float *invI, const float *gravityScale,
+                                                  physVec2 gravity, float halfDt, uint32_t count)
+    {
+        uint32_t i = 0;
+        float *vel = &linearVel[0].x;
+        const float *frc = &force[0].x;
+        const __m256 g = _mm256_setr_ps(gravity.x, gravity.y, gravity.x, gravity.y, gravity.x, gravity.y, gravity.x, gravity.y);
+        const __m256 h = _mm256_set1_ps(halfDt);
+        //  Eight bodies per step: four per linear vector, eight in the angular one.
+        for (; i + 8 <= count; i += 8)
+        {
+            for (uint32_t half = 0; half < 8; half += 4)
+            {
+                uint32_t b = i + half;
+                __m256 v = _mm256_loadu_ps(vel + 2 * b);
+                __m256 f = _mm256_loadu_ps(frc + 2 * b);
+                __m256 a = _mm256_add_ps(_mm256_mul_ps(f, LoadQuadSpread(invMass + b)), _mm256_mul_ps(g, LoadQuadSpread(gravityScale + b)));
+                _mm256_storeu_ps(vel + 2 * b, _mm256_add_ps(v, _mm256_mul_ps(a, h)));
+            }
+            __m256 w = _mm256_loadu_ps(angularVel + i);
+            __m256 t = _mm256_mul_ps(_mm256_loadu_ps(torque + i), _mm256_loadu_ps(invI + i));
+            _mm256_storeu_ps(angularVel + i, _mm256_add_ps(w, _mm256_mul_ps(t, h)));
+        }
+        _mm256_zeroupper();
+        IntegrateVelocitiesScalar(linearVel, angularVel, force, torque, invMass, invI, gravityScale, gravity, halfDt, i, count);
+    }
+
+    PHYS_TARGET_AVX2 void IntegratePositionsAvx2(physVec2 *position, const physVec2 *linearVel, float dt, uint32_t count)
+    {
+        uint32_t i = 0;
+        float *pos = &position[0].x;
+        const float *vel = &linearVel[0].x;
+        const __m256 d = _mm256_set1_ps(dt);
+        for (; i + 4 <= count; i += 4)
+            _mm256_storeu_ps(pos + 2 * i, _mm256_add_ps(_mm256_loadu_ps(pos + 2 * i), _mm256_mul_ps(_mm256_loadu_ps(vel + 2 * i), d)));
+        _mm256_zeroupper();
+        IntegratePositionsScalar(position, linearVel, dt, i, count);
+    }
+
+    PHYS_TARGET_AVX2 void ComputeCircleAABBsAvx2(physAABB *aabb, const physVec2 *position, const float *radius, uint32_t count)
+    {
+        uint32_t i = 0;
+        float *box = &aabb[0].topLeft.x;
+        const float *pos = &position[0].x;
+        const __m256 sign = _mm256_setr_ps(-1.f, -1.f, 1.f, 1.f, -1.f, -1.f, 1.f, 1.f);
+        const __m256i spread = _mm256_setr_epi32(0, 1, 0, 1, 2, 3, 2, 3);
+        const __m256i spreadRadius = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+        //  Two boxes per vector, (x - r, y - r, x + r, y + r) each.
+        for (; i + 2 <= count; i += 2)
+        {
+            __m256 p = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(pos + 2 * i)), spread);
+            __m256 r = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(radius + i)))), spreadRadius);
+            _mm256_storeu_ps(box + 4 * i, _mm256_add_ps(p, _mm256_mul_ps(r, sign)));
+        }
+        _mm256_zeroupper();
+        ComputeCircleAABBsScalar(aabb, position, radius, i, count);
+    }
+#endif
+}
+
+void IntegrateVelocities(physVec2 *linearVel, float *angularVel, const physVec2 *force, const float *torque,
+                         const float *invMass, const float *invI, const float *gravityScale,
+                         physVec2 gravity, float halfDt, uint32_t count)
+{
+#if PHYS_SIMD_AVX2
+    if (s_hasAvx2)
+    {
+        IntegrateVelocitiesAvx2(linearVel, angularVel, force, torque, invMass, invI, gravityScale, gravity, halfDt, count);
+        return;
+    }
+#endif
+    uint32_t i = 0;
+#if PHYS_SIMD_SSE2
+    float *vel = &linearVel[0].x;
+    const float *frc = &force[0].x;
+    const __m128 g = _mm_setr_ps(gravity.x, gravity.y, gravity.x, gravity.y);
+    const __m128 h = _mm_set1_ps(halfDt);
+    //  Four bodies per step: two per linear vector, four in the angular one.
+    for (; i + 4 <= count; i += 4)
+    {
+        for (uint32_t half = 0; half < 4; half += 2)
+        {
+            uint32_t b = i + half;
+            __m128 v = _mm_loadu_ps(vel + 2 * b);
+            __m128 f = _mm_loadu_ps(frc + 2 * b);
+            __m128 a = _mm_add_ps(_mm_mul_ps(f, LoadPairSpread(invMass + b)), _mm_mul_ps(g, LoadPairSpread(gravityScale + b)));
+            _mm_storeu_ps(vel + 2 * b, _mm_add_ps(v, _mm_mul_ps(a, h)));
+        }
+        __m128 w = _mm_loadu_ps(angularVel + i);
+        __m128 t = _mm_mul_ps(_mm_loadu_ps(torque + i), _mm_loadu_ps(invI + i));
+        _mm_storeu_ps(angularVel + i, _mm_add_ps(w, _mm_mul_ps(t, h)));
+    }
+#endif
+    IntegrateVelocitiesScalar(linearVel, angularVel, force, torque, invMass, invI, gravityScale, gravity, halfDt, i, count);
+}
+
+void IntegratePositions(physVec2 *position, const physVec2 *linearVel, float dt, uint32_t count)
+{
+#if PHYS_SIMD_AVX2
+    if (s_hasAvx2)
+    {
+        IntegratePositionsAvx2(position, linearVel, dt, count);
+        return;
+    }
+#endif
+    uint32_t i = 0;
+#if PHYS_SIMD_SSE2
+    float *pos = &position[0].x;
+    const float *vel = &linearVel[0].x;
+    const __m128 d = _mm_set1_ps(dt);
+    for (; i + 2 <= count; i += 2)
+        _mm_storeu_ps(pos + 2 * i, _mm_add_ps(_mm_loadu_ps(pos + 2 * i), _mm_mul_ps(_mm_loadu_ps(vel + 2 * i), d)));
+#endif
+    IntegratePositionsScalar(position, linearVel, dt, i, count);
+}
+
+void ComputeCircleAABBs(physAABB *aabb, const physVec2 *position, const float *radius, uint32_t count)
+{
+#if PHYS_SIMD_AVX2
+    if (s_hasAvx2)
+    {
+        ComputeCircleAABBsAvx2(aabb, position, radius, count);
+        return;
+    }
+#endif
+    uint32_t i = 0;
+#if PHYS_SIMD_SSE2
+    float *box = &aabb[0].topLeft.x;
+    const float *pos = &position[0].x;
+    const __m128 sign = _mm_setr_ps(-1.f, -1.f, 1.f, 1.f);
+    for (; i < count; ++i)
+    {
+        __m128 p = _mm_castpd_ps(_mm_load1_pd(reinterpret_cast<const double*>(pos + 2 * i)));
+        _mm_storeu_ps(box + 4 * i, _mm_add_ps(p, _mm_mul_ps(_mm_set1_ps(radius[i]), sign)));
+    }
+#endif
+    ComputeCircleAABBsScalar(aabb, position, radius, i, count);
+}
+
+const char* GetSimdPathName()
+{
+#if PHYS_SIMD_AVX2
+    if (s_hasAvx2)
+        return "AVX2";
+#endif
+#if PHYS_SIMD_SSE2
+    return "SSE2";
+#else
+    return "Scalar";
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "PhysicsShape.h"
+
+//  Sweeps over body state arrays. With PHYS_SIMD they use SSE2 on x86, and the scalar loop
+//  elsewhere. x86-64 builds with MSVC, GCC or Clang also compile AVX2 kernels, whatever the
+//  /arch or -m flags, and run them when CPUID reports AVX2. Every path does the same operations
+//  in the same order, so results match the scalar loop bit for bit.
+
+#ifndef PHYS_SIMD
+#define PHYS_SIMD 1
+#endif
+
+#if PHYS_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PHYS_SIMD_SSE2 1
+#endif
+#if PHYS_SIMD && (defined(__x86_64__) || defined(_M_X64)) && (defined(_MSC_VER) || defined(__GNUC__))
+#define PHYS_SIMD_AVX2 1
+#endif
+
+static_assert(sizeof(physVec2) == 2 * sizeof(float), "kernels treat physVec2 arrays as float pairs");
+static_assert(sizeof(physAABB) == 4 * sizeof(float), "kernels treat physAABB arrays as float quads");
+
+//  linearVel += (force * invMass + gravity * gravityScale) * halfDt
+//  angularVel += torque * invI * halfDt
+void IntegrateVelocities(physVec2 *linearVel, float *angularVel, const physVec2 *force, const float *torque,
+                         const float *invMass, const float *invI, const float *gravityScale,
+                         physVec2 gravity, float halfDt, uint32_t count);
+
+//  position += linearVel * dt
+void IntegratePositions(physVec2 *position, const physVec2 *linearVel, float dt, uint32_t count);
+
+//  aabb = position -+ radius. Bodies that are not circles get a meaningless box to overwrite.
+void ComputeCircleAABBs(physAABB *aabb, const physVec2 *position, const float *radius, uint32_t count);
+
+//  Kernels the calling CPU runs: "AVX2", "SSE2" or "Scalar".
+const char* GetSimdPathName();
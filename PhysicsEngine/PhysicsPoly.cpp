@@ -18,6 +18,7 @@ physPolyHandle::physPolyHandle(physVertex * firstVertex, unsigned int count) : m
 
 physPolyHandler::physPolyHandler()
 {
+	m_chunkIdx = 0;
 	m_tailIdx = 0;
 }
 
@@ -26,26 +27,52 @@ const physPolyHandle physPolyHandler::dummyHandle = physPolyHandle(&physPolyHand
 
 physPolyHandle physPolyHandler::CreatePoly(physVec2 *vertices, unsigned int count)
 {
-	if (m_tailIdx + count >= MAX_VERTICES)
+	if (count == 0)
 		return dummyHandle;
-	
-	physPolyHandle newHandle(&m_allVertices[m_tailIdx], count);
+
+	while (m_chunkIdx < m_chunks.size() && m_tailIdx + count > m_chunkSizes[m_chunkIdx])
+	{
+		++m_chunkIdx;
+		m_tailIdx = 0;
+	}
+	if (m_chunkIdx == m_chunks.size())
+		AllocateChunk(count > VERTEX_CHUNK_SIZE ? count : VERTEX_CHUNK_SIZE);
+
+	physVertex *polyVertices = &m_chunks[m_chunkIdx][m_tailIdx];
+	physPolyHandle newHandle(polyVertices, count);
 	for (unsigned int i = 0; i < count; ++i)
-		m_allVertices[i + m_tailIdx].position = vertices[i];
+		polyVertices[i].position = vertices[i];
 	for (unsigned int i = 0; i < count; ++i)
 	{
-		physVec2 face = m_allVertices[((i + 1) % count) + m_tailIdx].position - m_allVertices[i + m_tailIdx].position;
-		m_allVertices[i + m_tailIdx].normal = physVec2(face.y, -face.x);
-		m_allVertices[i + m_tailIdx].normal.normalize();
+		physVec2 face = polyVertices[(i + 1) % count].position - polyVertices[i].position;
+		polyVertices[i].normal = physVec2(face.y, -face.x);
+		polyVertices[i].normal.normalize();
 	}
 	m_tailIdx += count;
 	return newHandle;
 }
 
+void physPolyHandler::Reserve(unsigned int vertexCount)
+{
+	unsigned int capacity = 0;
+	for (auto size : m_chunkSizes)
+		capacity += size;
+	if (capacity < vertexCount)
+		AllocateChunk(vertexCount - capacity > VERTEX_CHUNK_SIZE ? vertexCount - capacity : VERTEX_CHUNK_SIZE);
+}
+
+void physPolyHandler::AllocateChunk(unsigned int size)
+{
+	m_chunks.emplace_back(new physVertex[size]);
+	m_chunkSizes.push_back(size);
+}
+
 void physPolyHandler::DestroyAll()
 {
-	for (uint32_t i = 0; i < m_tailIdx; ++i)
-		m_allVertices[i] = m_dummyVertex;
+	for (uint32_t c = 0; c < m_chunks.size() && c <= m_chunkIdx; ++c)
+		for (uint32_t i = 0; i < m_chunkSizes[c]; ++i)
+			m_chunks[c][i] = m_dummyVertex;
+	m_chunkIdx = 0;
 	m_tailIdx = 0;
 }
 
@@ -53,4 +80,3 @@ void physPolyHandler::DestroyPoly(const physPolyHandler & polygon)
 {
 	//	TODO
 }
-
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <vector>
+#include <memory>
 #include "PhysicsMath.h"
 
-constexpr unsigned int MAX_VERTICES = 20100;
+constexpr unsigned int VERTEX_CHUNK_SIZE = 4096;
 
 struct physVertex
 {
@@ -19,6 +21,7 @@ public:
 
 	physVertex& At(unsigned int i) const { return m_vertArray[i % m_vertCount]; }
 	unsigned int GetCount() const { return m_vertCount; }
+	physVertex* GetVertices() const { return m_vertArray; }
 
 private:
 	physVertex* m_vertArray;
@@ -33,12 +36,18 @@ public:
 	static const physPolyHandle dummyHandle;
 
 	physPolyHandle CreatePoly(physVec2 *vertices, unsigned int count);
+	void Reserve(unsigned int vertexCount);
 
 	void DestroyAll();
 	void DestroyPoly(const physPolyHandler& polygon);
 
 private:
-	physVertex m_allVertices[MAX_VERTICES];
+	void AllocateChunk(unsigned int size);
+
+	//	Polygons never cross chunk borders, so every handle points to contiguous vertices.
+	std::vector<std::unique_ptr<physVertex[]>> m_chunks;
+	std::vector<unsigned int> m_chunkSizes;
 	static physVertex m_dummyVertex;
+	unsigned int m_chunkIdx;
 	unsigned int m_tailIdx;
 };
\ No newline at end of file
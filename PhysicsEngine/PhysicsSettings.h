@@ -1,18 +1,42 @@
 #pragma once
 
 constexpr float DT = 1.f / 20.f;
-constexpr unsigned int MAX_BODIES = 500;
 
-constexpr unsigned int MAX_CIRCLES = MAX_BODIES;
-constexpr unsigned int MAX_POLYGONS = MAX_BODIES;
-constexpr unsigned int MAX_COLLISIONS = 15000000;
+//  Initial capacities of a world, physWorld::Reserve preallocates more.
+constexpr unsigned int DEFAULT_BODY_CAPACITY = 512;
+constexpr unsigned int COLLISIONS_PER_BODY_RESERVE = 4;
 
-#define BP_NAIVE 0
-#define BP_UNIFORM 8
-#define BP_UNIFORM_FIXED 9
-#define BP_UNIFORM_OPENHASH 10
-#define BP_UNIFORM_CLOSEDHASH 11
-#define BP_HIERARCHICAL_GRID 4
-#define BP_QUADTREE 5
+//  The contact cache hands out entries from blocks of CONTACT_CACHE_BLOCK_SIZE, its key table
+//  starts at CONTACT_CACHE_MIN_TABLE slots (a power of two) and doubles when half full.
+constexpr unsigned int CONTACT_CACHE_BLOCK_SIZE = 1024;
+constexpr unsigned int CONTACT_CACHE_MIN_TABLE = 1024;
 
-#define BP BP_QUADTREE
\ No newline at end of file
+//  Default iteration counts of the contact solver, physWorld::SetSolverIterations changes them.
+constexpr unsigned int SOLVER_ITERATIONS = 4;
+constexpr unsigned int SOLVER_POSITION_ITERATIONS = 1;
+constexpr float RESTITUTION_VELOCITY_THRESHOLD = 1.f;
+
+//  With a thread pool, steps with at least SOLVER_PARALLEL_MIN_CONTACTS touching pairs are solved
+//  in parallel. Islands from SOLVER_COLOR_MIN_CONTACTS pairs up are graph colored, smaller ones
+//  are solved whole. A task gets about SOLVER_BATCH_CONTACTS pairs.
+constexpr unsigned int SOLVER_PARALLEL_MIN_CONTACTS = 128;
+constexpr unsigned int SOLVER_COLOR_MIN_CONTACTS = 256;
+constexpr unsigned int SOLVER_BATCH_CONTACTS = 64;
+
+//  Bodies per task of the parallel integration. Slices of awake bodies span gaps of up to
+//  INTEGRATE_SLICE_GAP static or sleeping ones, shorter gaps cost less to sweep over than to split at.
+constexpr unsigned int INTEGRATE_TASK_BODIES = 256;
+constexpr unsigned int INTEGRATE_SLICE_GAP = 16;
+
+//  The parallel narrow phase aims at NARROW_PHASE_TASKS_PER_THREAD tasks per thread, each of
+//  at least NARROW_PHASE_TASK_COST, in units of one circle-circle test.
+constexpr unsigned int NARROW_PHASE_TASK_COST = 64;
+constexpr unsigned int NARROW_PHASE_TASKS_PER_THREAD = 8;
+
+//  Polygon pairs up to this vertex count use the separating axis narrow phase.
+constexpr unsigned int SAT_MAX_VERTICES = 8;
+
+//  Islands whose bodies all stay below both velocities for SLEEP_TIME seconds fall asleep.
+constexpr float SLEEP_LINEAR_VELOCITY = 0.5f;
+constexpr float SLEEP_ANGULAR_VELOCITY = 2.f * 3.14159265f / 180.f;
+constexpr float SLEEP_TIME = 0.5f;
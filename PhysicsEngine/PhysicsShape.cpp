@@ -6,13 +6,13 @@ float physShape::GetArea()
 	return m_area;
 }
 
-physCircleShape::physCircleShape()
+physCircleShape::physCircleShape() : physShape(sCircle)
 {
 	m_radius = 0;
 	m_area = 0;
 }
 
-physCircleShape::physCircleShape(float radius) : m_radius(radius)
+physCircleShape::physCircleShape(float radius) : physShape(sCircle), m_radius(radius)
 {
 	m_radius = radius;
 }
@@ -22,11 +22,6 @@ void physCircleShape::Initialize()
 	ComputeArea();
 }
 
-physShape::Type physCircleShape::GetType()
-{
-	return sCircle;
-}
-
 float physCircleShape::GetRadius() const
 {
 	return m_radius;
@@ -37,12 +32,12 @@ void physCircleShape::ComputeArea()
 	m_area = m_radius * m_radius * static_cast<float>(M_PI);
 }
 
-physPolyShape::physPolyShape()
+physPolyShape::physPolyShape() : physShape(sPoly)
 {
 	m_area = 0;
 }
 
-physPolyShape::physPolyShape(physPolyHandle polygon) : m_polygon(polygon)
+physPolyShape::physPolyShape(physPolyHandle polygon) : physShape(sPoly), m_polygon(polygon)
 {
 }
 
@@ -52,11 +47,6 @@ void physPolyShape::Initialize()
 	AdjustByCentroid();
 }
 
-physShape::Type physPolyShape::GetType()
-{
-	return sPoly;
-}
-
 physPolyHandle & physPolyShape::GetPolygon()
 {
 	return m_polygon;
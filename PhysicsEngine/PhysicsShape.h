@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include "PhysicsPoly.h"
 
 struct physAABB
@@ -11,6 +12,7 @@ struct physAABB
 
 	inline physVec2 GetCenter() const;
 	inline physVec2 GetExtents() const;
+	inline float GetPerimeter() const;
 	inline bool Contains(const physAABB& aabb) const;
 	inline bool Intersects(const physAABB& aabb) const;
 	inline physAABB Combine(const physAABB& rhs) const;
@@ -25,6 +27,10 @@ inline physVec2 physAABB::GetExtents() const
 {
 	return (botRight - topLeft) * 0.5f;
 }
+inline float physAABB::GetPerimeter() const
+{
+	return 2.f * ((botRight.x - topLeft.x) + (botRight.y - topLeft.y));
+}
 inline bool physAABB::Contains(const physAABB& aabb) const
 {
 	bool result;
@@ -56,24 +62,27 @@ inline physAABB physAABB::Combine(const physAABB& rhs) const
 class physShape
 {
 public:
-	enum Type
+	enum Type : uint8_t
 	{
 		sCircle,
-		sPoly
+		sPoly,
+		sCount
 	};
 
-	physShape() : m_area(0) {};
+	explicit physShape(Type type) : m_area(0), m_type(type) {};
 	virtual ~physShape() {};
 
 	virtual void Initialize() = 0;
 
-	virtual Type GetType() = 0;
+	//	Stored tag rather than a virtual call, so hot paths can switch on it and static_cast.
+	Type GetType() const { return m_type; }
 	float GetArea();
 
 protected:
 	virtual void ComputeArea() = 0;
 	
 	float m_area;
+	Type m_type;
 };
 
 class physCircleShape : public physShape
@@ -84,7 +93,6 @@ public:
 
 	void Initialize() override;
 
-	Type GetType() override;
 	float GetRadius() const;
 
 protected:
@@ -102,7 +110,6 @@ public:
 
 	void Initialize() override;
 
-	Type GetType() override;
 	physPolyHandle & GetPolygon();
 
 protected:
@@ -0,0 +1,234 @@
+#include "PhysicsSolver.h"
+
+#include <algorithm>
+#include "PhysicsBody.h"
+#include "PhysicsCollision.h"
+#include "PhysicsThreadPool.h"
+#include "Benchmark.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    constexpr uint32_t MAX_COLORS = 64;
+    constexpr uint32_t NO_ISLAND = UINT32_MAX;
+
+    uint32_t LowestBit(uint64_t value)
+    {
+#if defined(_MSC_VER)
+        unsigned long idx;
+        _BitScanForward64(&idx, value);
+        return idx;
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    //  Without a pool the tasks run in order on the calling thread.
+    void RunTasks(physThreadPool * threadPool, uint32_t taskCount, const physThreadPool::Task & task)
+    {
+        if (threadPool != nullptr)
+        {
+            threadPool->ParallelFor(taskCount, task);
+            return;
+        }
+        for (uint32_t i = 0; i < taskCount; ++i)
+            task(i, 0);
+    }
+}
+
+void physContactSolver::SetIterations(uint32_t velocityIterations, uint32_t positionIterations)
+{
+    m_velocityIterations = velocityIterations;
+    m_positionIterations = positionIterations;
+}
+
+void physContactSolver::Solve(const std::vector<physCollision*> & contacts)
+{
+    uint32_t count = uint32_t(contacts.size());
+    if ((m_threadPool == nullptr && !m_deterministic) || count < SOLVER_PARALLEL_MIN_CONTACTS)
+    {
+        if (m_trackIslands)
+            LinkIslands(contacts);
+        SolveSerial(contacts.data(), count);
+        return;
+    }
+
+    BuildIslands(contacts);
+    ColorContacts();
+
+    RunTasks(m_threadPool, uint32_t(m_islandBatches.size()), [&](uint32_t taskIdx, uint32_t)
+    {
+        PHYS_PROFILE_ZONE(SolverTask);
+        const Range & batch = m_islandBatches[taskIdx];
+        SolveSerial(m_islandContacts.data() + batch.first, batch.count);
+    });
+
+    if (m_coloredInput.empty())
+        return;
+    for (uint32_t i = 0; i < m_velocityIterations; ++i)
+        SolveColors(&physCollision::Solve);
+    for (uint32_t i = 0; i < m_positionIterations; ++i)
+        SolveColors(&physCollision::PositionalCorrection);
+}
+
+void physContactSolver::SolveSerial(physCollision * const * contacts, uint32_t count) const
+{
+    for (uint32_t i = 0; i < m_velocityIterations; ++i)
+        for (uint32_t c = 0; c < count; ++c)
+            contacts[c]->Solve();
+    for (uint32_t i = 0; i < m_positionIterations; ++i)
+        for (uint32_t c = 0; c < count; ++c)
+            contacts[c]->PositionalCorrection();
+}
+
+void physContactSolver::LinkIslands(const std::vector<physCollision*> & contacts)
+{
+    uint32_t bodyCount = 0;
+    for (auto col : contacts)
+        bodyCount = std::max(bodyCount, std::max(col->A->GetId(), col->B->GetId()) + 1);
+
+    //  Static bodies are only read by the solver, they do not join islands.
+    m_islands.Reset(bodyCount);
+    for (auto col : contacts)
+        if (!col->A->IsStatic() && !col->B->IsStatic())
+            m_islands.Link(col->A->GetId(), col->B->GetId());
+}
+
+void physContactSolver::BuildIslands(const std::vector<physCollision*> & contacts)
+{
+    LinkIslands(contacts);
+    uint32_t bodyCount = m_islands.GetCount();
+
+    m_islandOfRoot.assign(bodyCount, NO_ISLAND);
+    m_contactIslands.resize(contacts.size());
+    m_islandStart.clear();
+    for (size_t i = 0; i < contacts.size(); ++i)
+    {
+        physBody *body = contacts[i]->A->IsStatic() ? contacts[i]->B : contacts[i]->A;
+        uint32_t root = m_islands.Find(body->GetId());
+        if (m_islandOfRoot[root] == NO_ISLAND)
+        {
+            m_islandOfRoot[root] = uint32_t(m_islandStart.size());
+            m_islandStart.push_back(0);
+        }
+        m_contactIslands[i] = m_islandOfRoot[root];
+        ++m_islandStart[m_contactIslands[i]];
+    }
+
+    //  Counting sort by island keeps the original order of pairs within an island, which makes
+    //  solving an island on its own match the serial loop.
+    uint32_t islandCount = uint32_t(m_islandStart.size());
+    uint32_t offset = 0;
+    for (uint32_t k = 0; k < islandCount; ++k)
+    {
+        uint32_t size = m_islandStart[k];
+        m_islandStart[k] = offset;
+        offset += size;
+    }
+    m_islandStart.push_back(offset);
+
+    m_islandContacts.resize(contacts.size());
+    for (size_t i = 0; i < contacts.size(); ++i)
+        m_islandContacts[m_islandStart[m_contactIslands[i]]++] = contacts[i];
+    for (uint32_t k = islandCount; k > 0; --k)
+        m_islandStart[k] = m_islandStart[k - 1];
+    m_islandStart[0] = 0;
+
+    m_islandBatches.clear();
+    m_coloredInput.clear();
+    Range batch = { 0, 0 };
+    for (uint32_t k = 0; k < islandCount; ++k)
+    {
+        uint32_t first = m_islandStart[k];
+        uint32_t size = m_islandStart[k + 1] - first;
+        if (size >= SOLVER_COLOR_MIN_CONTACTS)
+        {
+            if (batch.count > 0)
+                m_islandBatches.push_back(batch);
+            batch.count = 0;
+            m_coloredInput.insert(m_coloredInput.end(), m_islandContacts.begin() + first, m_islandContacts.begin() + first + size);
+            continue;
+        }
+
+        if (batch.count == 0)
+            batch.first = first;
+        batch.count += size;
+        if (batch.count >= SOLVER_BATCH_CONTACTS)
+        {
+            m_islandBatches.push_back(batch);
+            batch.count = 0;
+        }
+    }
+    if (batch.count > 0)
+        m_islandBatches.push_back(batch);
+}
+
+void physContactSolver::ColorContacts()
+{
+    //  Greedy coloring in pair order: every pair takes the lowest color neither of its dynamic
+    //  bodies has yet. Static bodies are shared freely, the solver does not write them.
+    m_bodyColors.assign(m_islandOfRoot.size(), 0);
+    m_contactColors.resize(m_coloredInput.size());
+    uint32_t colorCounts[MAX_COLORS + 1] = { 0 };
+    for (size_t i = 0; i < m_coloredInput.size(); ++i)
+    {
+        physBody *A = m_coloredInput[i]->A;
+        physBody *B = m_coloredInput[i]->B;
+        uint64_t used = (A->IsStatic() ? 0 : m_bodyColors[A->GetId()]) | (B->IsStatic() ? 0 : m_bodyColors[B->GetId()]);
+        uint32_t color = ~used ? LowestBit(~used) : MAX_COLORS;
+        if (color < MAX_COLORS)
+        {
+            uint64_t bit = uint64_t(1) << color;
+            if (!A->IsStatic())
+                m_bodyColors[A->GetId()] |= bit;
+            if (!B->IsStatic())
+                m_bodyColors[B->GetId()] |= bit;
+        }
+        m_contactColors[i] = uint8_t(color);
+        ++colorCounts[color];
+    }
+
+    //  A pair only gets a color when all lower ones are taken, so used colors are contiguous.
+    m_colors.clear();
+    uint32_t offset = 0;
+    for (uint32_t c = 0; c <= MAX_COLORS; ++c)
+    {
+        if (colorCounts[c] == 0 && c < MAX_COLORS)
+            c = MAX_COLORS;
+        m_colors.push_back({ offset, colorCounts[c] });
+        offset += colorCounts[c];
+    }
+
+    m_colored.resize(m_coloredInput.size());
+    for (size_t i = 0; i < m_coloredInput.size(); ++i)
+    {
+        Range & color = m_colors[std::min(uint32_t(m_contactColors[i]), uint32_t(m_colors.size() - 1))];
+        m_colored[color.first + color.count - colorCounts[m_contactColors[i]]--] = m_coloredInput[i];
+    }
+}
+
+void physContactSolver::SolveColors(void (physCollision::*step)())
+{
+    //  Pairs of one color share no dynamic body, the order they run in does not matter.
+    uint32_t colorCount = uint32_t(m_colors.size()) - 1;
+    for (uint32_t c = 0; c < colorCount; ++c)
+    {
+        const Range color = m_colors[c];
+        uint32_t taskCount = (color.count + SOLVER_BATCH_CONTACTS - 1) / SOLVER_BATCH_CONTACTS;
+        RunTasks(m_threadPool, taskCount, [&](uint32_t taskIdx, uint32_t)
+        {
+            PHYS_PROFILE_ZONE(SolverTask);
+            uint32_t first = color.first + taskIdx * SOLVER_BATCH_CONTACTS;
+            uint32_t last = std::min(first + SOLVER_BATCH_CONTACTS, color.first + color.count);
+            for (uint32_t i = first; i < last; ++i)
+                (m_colored[i]->*step)();
+        });
+    }
+
+    const Range & overflow = m_colors[colorCount];
+    for (uint32_t i = overflow.first; i < overflow.first + overflow.count; ++i)
+        (m_colored[i]->*step)();
+}
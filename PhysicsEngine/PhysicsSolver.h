@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "PhysicsIsland.h"
+#include "PhysicsSettings.h"
+
+struct physCollision;
+class physThreadPool;
+
+//  Velocity and position iterations over the touching pairs of a step. Without a thread pool,
+//  or with few pairs, every pair is visited in order. Otherwise pairs are split into islands
+//  of dynamic bodies: small islands are solved whole on one thread each, in the same order as
+//  the serial loop, and larger ones in graph-colored batches whose pairs share no dynamic body,
+//  so a batch runs in parallel without locks. The split depends only on the pairs, so results
+//  are the same on every run and for every thread count above one. Deterministic mode uses the
+//  split on a single thread as well, which makes results match for any thread count.
+
+class physContactSolver
+{
+public:
+    void SetThreadPool(physThreadPool * threadPool) { m_threadPool = threadPool; }
+    void SetDeterministic(bool flag) { m_deterministic = flag; }
+    //  Links the bodies of the pairs of every Solve into GetIslands(), also when they are solved
+    //  serially. The world reuses the islands to put bodies to sleep, on by default.
+    void SetTrackIslands(bool flag) { m_trackIslands = flag; }
+    physIslandSet & GetIslands() { return m_islands; }
+
+    void SetIterations(uint32_t velocityIterations, uint32_t positionIterations);
+    uint32_t GetVelocityIterations() const { return m_velocityIterations; }
+    uint32_t GetPositionIterations() const { return m_positionIterations; }
+
+    //  Pairs must be initialized and warm started, which wakes all of their bodies.
+    void Solve(const std::vector<physCollision*> & contacts);
+
+private:
+    //  Range of pairs run by one task or, for colors, by one parallel loop.
+    struct Range
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    void SolveSerial(physCollision * const * contacts, uint32_t count) const;
+    void LinkIslands(const std::vector<physCollision*> & contacts);
+    void BuildIslands(const std::vector<physCollision*> & contacts);
+    void ColorContacts();
+    void SolveColors(void (physCollision::*step)());
+
+    physThreadPool *m_threadPool = nullptr;
+    bool m_deterministic = false;
+    bool m_trackIslands = true;
+    uint32_t m_velocityIterations = SOLVER_ITERATIONS;
+    uint32_t m_positionIterations = SOLVER_POSITION_ITERATIONS;
+
+    physIslandSet m_islands;
+    //  Island index of every root body id, pairs grouped by island in order of first appearance.
+    std::vector<uint32_t> m_islandOfRoot;
+    std::vector<uint32_t> m_contactIslands;
+    std::vector<uint32_t> m_islandStart;
+    std::vector<physCollision*> m_islandContacts;
+    //  Consecutive small islands, one task each.
+    std::vector<Range> m_islandBatches;
+
+    //  Pairs of large islands, grouped by color. The last range holds pairs that found no free
+    //  color, they are solved serially after the others.
+    std::vector<physCollision*> m_coloredInput;
+    std::vector<physCollision*> m_colored;
+    std::vector<uint8_t> m_contactColors;
+    std::vector<Range> m_colors;
+    std::vector<uint64_t> m_bodyColors;
+};
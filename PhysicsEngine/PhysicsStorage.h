@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+//  Growable array made of fixed size chunks. Growing only adds chunks, so elements never move
+//  and pointers to them stay valid until Clear.
+
+template<typename T, uint32_t ChunkShift>
+class physChunkedArray
+{
+public:
+    static constexpr uint32_t CHUNK_SIZE = 1u << ChunkShift;
+    static constexpr uint32_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+    T & operator[](uint32_t idx)
+    {
+        return m_chunks[idx >> ChunkShift][idx & CHUNK_MASK];
+    }
+
+    const T & operator[](uint32_t idx) const
+    {
+        return m_chunks[idx >> ChunkShift][idx & CHUNK_MASK];
+    }
+
+    //  Returns the next free element, default constructed.
+    T & Append()
+    {
+        Reserve(m_size + 1);
+        return (*this)[m_size++];
+    }
+
+    void Reserve(uint32_t capacity)
+    {
+        while (GetCapacity() < capacity)
+        {
+            m_chunks.emplace_back(new T[CHUNK_SIZE]);
+            m_chunkTable.push_back(m_chunks.back().get());
+        }
+    }
+
+    //  Resets used elements to default and keeps the chunks for reuse.
+    void Clear()
+    {
+        for (uint32_t i = 0; i < m_size; ++i)
+            (*this)[i] = T();
+        m_size = 0;
+    }
+
+    uint32_t GetSize() const { return m_size; }
+    uint32_t GetCapacity() const { return uint32_t(m_chunks.size()) << ChunkShift; }
+
+    //  Table of chunk pointers, changes when a chunk is added.
+    T * const * GetChunks() const { return m_chunkTable.data(); }
+
+private:
+    std::vector<std::unique_ptr<T[]>> m_chunks;
+    std::vector<T*> m_chunkTable;
+    uint32_t m_size = 0;
+};
+
+//  Vector with inline storage for at most Capacity elements, for scratch data that must not
+//  touch the heap. Callers check IsFull before growing it.
+
+template<typename T, uint32_t Capacity>
+class physFixedVector
+{
+public:
+    T & operator[](uint32_t idx) { return m_items[idx]; }
+    const T & operator[](uint32_t idx) const { return m_items[idx]; }
+
+    T & Back() { return m_items[m_size - 1]; }
+
+    void PushBack(const T & item)
+    {
+        m_items[m_size++] = item;
+    }
+
+    void Insert(uint32_t idx, const T & item)
+    {
+        for (uint32_t i = m_size; i > idx; --i)
+            m_items[i] = m_items[i - 1];
+        m_items[idx] = item;
+        ++m_size;
+    }
+
+    void Erase(uint32_t idx)
+    {
+        for (uint32_t i = idx + 1; i < m_size; ++i)
+            m_items[i - 1] = m_items[i];
+        --m_size;
+    }
+
+    void Clear() { m_size = 0; }
+
+    uint32_t GetSize() const { return m_size; }
+    bool IsFull() const { return m_size == Capacity; }
+
+private:
+    T m_items[Capacity];
+    uint32_t m_size = 0;
+};
@@ -0,0 +1,187 @@
+#include "PhysicsThreadPool.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    void PinThread(std::thread & thread, uint32_t core)
+    {
+#if defined(_WIN32)
+        if (core < 8 * sizeof(DWORD_PTR))
+            SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+        cpu_set_t cores;
+        CPU_ZERO(&cores);
+        CPU_SET(core, &cores);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cores), &cores);
+#else
+        (void)thread;
+        (void)core;
+#endif
+    }
+}
+
+physThreadPool::physThreadPool(uint32_t threadCount, bool pinThreads, uint32_t firstCore)
+{
+    threadCount = std::max(threadCount, 1u);
+    m_ranges = std::make_unique<TaskRange[]>(threadCount);
+
+    uint32_t coreCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        m_workers.emplace_back(&physThreadPool::WorkerLoop, this, i);
+        if (pinThreads)
+            PinThread(m_workers.back(), (firstCore + i - 1) % coreCount);
+    }
+}
+
+physThreadPool::~physThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wakeUp.notify_all();
+    for (auto & worker : m_workers)
+        worker.join();
+}
+
+uint32_t physThreadPool::GetThreadCount() const
+{
+    return uint32_t(m_workers.size()) + 1;
+}
+
+void physThreadPool::ParallelFor(uint32_t taskCount, const Task & task)
+{
+    if (m_workers.empty() || taskCount <= 1)
+    {
+        for (uint32_t i = 0; i < taskCount; ++i)
+            task(i, 0);
+        return;
+    }
+
+    //  Even contiguous shares, neighbouring tasks usually touch neighbouring data.
+    uint32_t threadCount = GetThreadCount();
+    for (uint32_t t = 0; t < threadCount; ++t)
+    {
+        uint32_t begin = uint32_t(uint64_t(taskCount) * t / threadCount);
+        uint32_t end = uint32_t(uint64_t(taskCount) * (t + 1) / threadCount);
+        m_ranges[t].tasks.store(PackRange(begin, end), std::memory_order_relaxed);
+    }
+    RunBatch(task, true);
+}
+
+void physThreadPool::RunOnEachThread(const Task & task)
+{
+    //  Without stealing every thread runs just the one task of its own range.
+    for (uint32_t t = 0; t < GetThreadCount(); ++t)
+        m_ranges[t].tasks.store(PackRange(t, t + 1), std::memory_order_relaxed);
+    RunBatch(task, false);
+}
+
+void physThreadPool::RunBatch(const Task & task, bool steal)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_steal = steal;
+#if PHYS_PROFILE
+        m_zone = Benchmark::Get().GetCurrentZone();
+#endif
+        m_busyWorkers = uint32_t(m_workers.size());
+        ++m_generation;
+    }
+    m_wakeUp.notify_all();
+
+    RunTasks(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+    m_task = nullptr;
+}
+
+void physThreadPool::WorkerLoop(uint32_t threadIdx)
+{
+    uint64_t generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [&] { return m_quit || m_generation != generation; });
+            if (m_quit)
+                return;
+            generation = m_generation;
+        }
+
+        {
+            PHYS_PROFILE_COUNTERS(m_zone);
+            RunTasks(threadIdx);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_busyWorkers == 0)
+            m_done.notify_one();
+    }
+}
+
+void physThreadPool::RunTasks(uint32_t threadIdx)
+{
+    uint32_t taskIdx;
+    while (PopTask(threadIdx, taskIdx) || (m_steal && StealTask(threadIdx, taskIdx)))
+        (*m_task)(taskIdx, threadIdx);
+}
+
+bool physThreadPool::PopTask(uint32_t threadIdx, uint32_t & taskIdx)
+{
+    auto & tasks = m_ranges[threadIdx].tasks;
+    uint64_t range = tasks.load(std::memory_order_acquire);
+    while (true)
+    {
+        uint32_t begin = uint32_t(range >> 32);
+        uint32_t end = uint32_t(range);
+        if (begin >= end)
+            return false;
+        if (tasks.compare_exchange_weak(range, PackRange(begin + 1, end), std::memory_order_acq_rel))
+        {
+            taskIdx = begin;
+            return true;
+        }
+    }
+}
+
+bool physThreadPool::StealTask(uint32_t threadIdx, uint32_t & taskIdx)
+{
+    //  Victims are visited from the next thread on, so thieves spread over the pool. Only an
+    //  owner refills its range, and only while it is still running tasks, so a thread that
+    //  finds nothing can stop: whatever is left belongs to a thread that will run it.
+    uint32_t threadCount = GetThreadCount();
+    for (uint32_t offset = 1; offset < threadCount; ++offset)
+    {
+        auto & tasks = m_ranges[(threadIdx + offset) % threadCount].tasks;
+        uint64_t range = tasks.load(std::memory_order_acquire);
+        while (true)
+        {
+            uint32_t begin = uint32_t(range >> 32);
+            uint32_t end = uint32_t(range);
+            if (begin >= end)
+                break;
+
+            //  The back half, the first of it runs right away and the rest becomes our range.
+            uint32_t middle = begin + (end - begin) / 2;
+            if (tasks.compare_exchange_weak(range, PackRange(begin, middle), std::memory_order_acq_rel))
+            {
+                taskIdx = middle;
+                m_ranges[threadIdx].tasks.store(PackRange(middle + 1, end), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
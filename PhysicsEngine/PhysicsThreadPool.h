@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+#include <condition_variable>
+
+#include "Benchmark.h"
+
+//  Fixed set of worker threads running batches of indexed tasks. The calling thread
+//  takes part in every batch, so a pool of N threads starts N - 1 workers.
+//
+//  A batch is split into one contiguous range of tasks per thread. Every thread takes tasks
+//  from the front of its own range, and once it runs dry steals the back half of another
+//  thread's range, so cheap and expensive tasks even out without a shared counter. Which
+//  thread runs a task is not fixed; tasks that write their own outputs stay deterministic.
+//
+//  The pool runs one batch at a time and ParallelFor is not reentrant: a pool shared between
+//  worlds must only be used by one of them at a time.
+
+class physThreadPool
+{
+public:
+    //  Non-owning reference to a callable taking (taskIdx, threadIdx). Unlike std::function it
+    //  never allocates. The callable must outlive the call the reference is passed to, which a
+    //  lambda written in the argument list does.
+    class Task
+    {
+    public:
+        template<typename Fn, typename = std::enable_if_t<!std::is_same<std::decay_t<Fn>, Task>::value>>
+        Task(Fn && fn) :
+            m_callable(const_cast<void*>(static_cast<const void*>(&fn))),
+            m_invoke([](void * callable, uint32_t taskIdx, uint32_t threadIdx)
+            {
+                (*static_cast<std::remove_reference_t<Fn>*>(callable))(taskIdx, threadIdx);
+            }) {}
+
+        void operator()(uint32_t taskIdx, uint32_t threadIdx) const { m_invoke(m_callable, taskIdx, threadIdx); }
+
+    private:
+        void *m_callable;
+        void (*m_invoke)(void * callable, uint32_t taskIdx, uint32_t threadIdx);
+    };
+
+    //  With pinThreads, worker i (1-based) only runs on core (firstCore + i - 1) modulo the core
+    //  count, where the platform allows it. The calling thread keeps its own affinity.
+    explicit physThreadPool(uint32_t threadCount = std::thread::hardware_concurrency(),
+                            bool pinThreads = false, uint32_t firstCore = 0);
+    ~physThreadPool();
+
+    physThreadPool(physThreadPool const&) = delete;
+    void operator=(physThreadPool const&) = delete;
+
+    uint32_t GetThreadCount() const;
+
+    //  Runs task for every index in [0, taskCount) and returns when all of them are done.
+    void ParallelFor(uint32_t taskCount, const Task & task);
+
+    //  Runs task exactly once on every thread of the pool, with taskIdx equal to threadIdx, to
+    //  set up per-thread state such as hardware counters.
+    void RunOnEachThread(const Task & task);
+
+    //  Runs fn(first, last, threadIdx) over [0, count) in ranges of at most grain items.
+    template<typename Fn>
+    void ParallelForRange(uint32_t count, uint32_t grain, Fn && fn)
+    {
+        uint32_t taskCount = (count + grain - 1) / grain;
+        ParallelFor(taskCount, [&](uint32_t taskIdx, uint32_t threadIdx)
+        {
+            uint32_t first = taskIdx * grain;
+            fn(first, std::min(first + grain, count), threadIdx);
+        });
+    }
+
+private:
+    //  Tasks [begin, end) a thread has not started, packed in one word so the owner taking the
+    //  front and a thief taking the back half agree through a single compare-exchange.
+    struct alignas(64) TaskRange
+    {
+        std::atomic<uint64_t> tasks{ 0 };
+    };
+
+    static uint64_t PackRange(uint32_t begin, uint32_t end) { return (uint64_t(begin) << 32) | end; }
+
+    void RunBatch(const Task & task, bool steal);
+    void WorkerLoop(uint32_t threadIdx);
+    void RunTasks(uint32_t threadIdx);
+    bool PopTask(uint32_t threadIdx, uint32_t & taskIdx);
+    bool StealTask(uint32_t threadIdx, uint32_t & taskIdx);
+
+    std::vector<std::thread> m_workers;
+    std::unique_ptr<TaskRange[]> m_ranges;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_done;
+
+    const Task *m_task = nullptr;
+    bool m_steal = true;
+    //  Zone open on the calling thread, workers charge their hardware counters to it.
+    BenchZone m_zone = BenchZone::Count;
+    uint32_t m_busyWorkers = 0;
+    uint64_t m_generation = 0;
+    bool m_quit = false;
+};
@@ -0,0 +1,81 @@
+#include "PhysicsTrace.h"
+
+physTraceWriter::physTraceWriter(const std::string & path)
+    : m_file(path)
+{
+    if (!m_file)
+        return;
+    //  Zones recorded before the trace started are not part of it.
+    Benchmark::Get().DrainEvents(m_events);
+    m_events.clear();
+    m_origin = Benchmark::Now();
+    m_file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+}
+
+physTraceWriter::~physTraceWriter()
+{
+    if (m_file)
+        m_file << "\n]}\n";
+}
+
+bool physTraceWriter::IsOpen() const
+{
+    return bool(m_file);
+}
+
+void physTraceWriter::WriteStep(uint64_t stepIdx)
+{
+    if (!m_file)
+        return;
+
+    m_events.clear();
+    auto lost = Benchmark::Get().DrainEvents(m_events);
+
+    char line[256];
+    for (auto & e : m_events)
+    {
+        if (e.start < m_origin)
+            continue;
+        WriteThreadName(e.thread);
+
+        int length;
+        if (e.zone == BenchZone::Step)
+            length = snprintf(line, sizeof(line),
+                "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"step\":%llu}}",
+                m_firstEvent ? "" : ",", Benchmark::GetName(e.zone), unsigned(e.thread),
+                (e.start - m_origin) * 0.001, (e.end - e.start) * 0.001, (unsigned long long)stepIdx);
+        else
+            length = snprintf(line, sizeof(line),
+                "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                m_firstEvent ? "" : ",", Benchmark::GetName(e.zone), unsigned(e.thread),
+                (e.start - m_origin) * 0.001, (e.end - e.start) * 0.001);
+        m_file.write(line, length);
+        m_firstEvent = false;
+    }
+
+    //  A step that recorded more zones than a ring holds shows up as an instant marker.
+    if (lost)
+    {
+        auto length = snprintf(line, sizeof(line),
+            "%s\n{\"name\":\"Lost %llu zones\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}",
+            m_firstEvent ? "" : ",", (unsigned long long)lost, (Benchmark::Now() - m_origin) * 0.001);
+        m_file.write(line, length);
+        m_firstEvent = false;
+    }
+}
+
+void physTraceWriter::WriteThreadName(uint16_t thread)
+{
+    if (thread < m_namedThreads.size() && m_namedThreads[thread])
+        return;
+    if (thread >= m_namedThreads.size())
+        m_namedThreads.resize(thread + 1, false);
+    m_namedThreads[thread] = true;
+
+    char line[128];
+    auto length = snprintf(line, sizeof(line),
+        "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+        m_firstEvent ? "" : ",", unsigned(thread), unsigned(thread));
+    m_file.write(line, length);
+    m_firstEvent = false;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+
+//  Streams the profiler zones as Chrome Trace Event JSON, viewable in chrome://tracing or
+//  Perfetto. Every WriteStep appends the zones recorded since the previous call, one track per
+//  profiler thread.
+
+class physTraceWriter
+{
+public:
+    explicit physTraceWriter(const std::string & path);
+    ~physTraceWriter();
+
+    physTraceWriter(const physTraceWriter&) = delete;
+    void operator=(const physTraceWriter&) = delete;
+
+    bool IsOpen() const;
+
+    //  Call between steps, when no zone is being recorded.
+    void WriteStep(uint64_t stepIdx);
+
+private:
+    void WriteThreadName(uint16_t thread);
+
+    std::ofstream m_file;
+    std::vector<BenchEvent> m_events;
+    std::vector<bool> m_namedThreads;
+    uint64_t m_origin = 0;
+    bool m_firstEvent = true;
+};
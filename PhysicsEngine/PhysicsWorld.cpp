@@ -1,14 +1,18 @@
 #include "PhysicsWorld.h"
 #include "PhysicsBroadPhase.h"
 #include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include "Benchmark.h"
+#include "PhysicsKernels.h"
 
-physWorld::physWorld()
+physWorld::physWorld(physBroadPhase::Type broadPhase)
 {
-	m_curCircleIdx = 0;
-	m_curPolyIdx = 0;
-    m_bodies.Reset();
+    m_bodies.Reserve(DEFAULT_BODY_CAPACITY);
     m_collisions.Reset();
+    m_collisions.Reserve(DEFAULT_BODY_CAPACITY * COLLISIONS_PER_BODY_RESERVE);
+    if (!SetBroadPhase(broadPhase))
+        SetBroadPhase(physBroadPhase::bpQuadTree);
 }
 
 void physWorld::SetGravity(const physVec2 & gravity)
@@ -16,31 +20,221 @@ void physWorld::SetGravity(const physVec2 & gravity)
 	m_gravity = gravity;
 }
 
+bool physWorld::SetBroadPhase(physBroadPhase::Type type)
+{
+    //  Create has nothing for bpCount or unknown values, the current broad phase then stays.
+    auto broadPhase = physBroadPhase::Create(type);
+    if (!broadPhase)
+        return false;
+    m_broadPhase = std::move(broadPhase);
+    m_broadPhase->SetThreadPool(m_threadPool);
+    m_broadPhaseType = type;
+    return true;
+}
+
+void physWorld::SetThreadCount(uint32_t threadCount, bool pinThreads, uint32_t firstCore)
+{
+    SetThreadPool(nullptr);
+    if (threadCount > 1)
+        m_ownedThreadPool = std::make_unique<physThreadPool>(threadCount, pinThreads, firstCore);
+    SetThreadPool(m_ownedThreadPool.get());
+}
+
+void physWorld::SetThreadPool(physThreadPool * threadPool)
+{
+    if (threadPool != m_ownedThreadPool.get())
+        m_ownedThreadPool.reset();
+    m_threadPool = threadPool;
+    m_broadPhase->SetThreadPool(m_threadPool);
+    m_collisions.solver.SetThreadPool(m_threadPool);
+}
+
+uint32_t physWorld::GetThreadCount() const
+{
+    return m_threadPool ? m_threadPool->GetThreadCount() : 1;
+}
+
+void physWorld::SetSolverIterations(uint32_t velocityIterations, uint32_t positionIterations)
+{
+    m_collisions.solver.SetIterations(velocityIterations, positionIterations);
+}
+
+uint32_t physWorld::GetVelocityIterations() const
+{
+    return m_collisions.solver.GetVelocityIterations();
+}
+
+uint32_t physWorld::GetPositionIterations() const
+{
+    return m_collisions.solver.GetPositionIterations();
+}
+
+void physWorld::SetDeterministic(bool flag)
+{
+    m_deterministic = flag;
+    m_collisions.solver.SetDeterministic(flag);
+}
+
+bool physWorld::IsDeterministic() const
+{
+    return m_deterministic;
+}
+
+uint64_t physWorld::ComputeStateHash() const
+{
+    //  FNV-1a over 32-bit words, the bit patterns of the floats rather than their values.
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint32_t word)
+    {
+        hash = (hash ^ word) * 1099511628211ull;
+    };
+    auto mixFloat = [&mix](float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        mix(bits);
+    };
+
+    for (uint32_t i = 0; i < m_bodies.GetCount(); ++i)
+    {
+        auto & body = m_bodies.bodies[i];
+        physVec2 pos = body.GetPos();
+        physRot rot = body.GetRot();
+        physVec2 vel = body.GetLinearVelocity();
+        mixFloat(pos.x);
+        mixFloat(pos.y);
+        mixFloat(rot.sin);
+        mixFloat(rot.cos);
+        mixFloat(vel.x);
+        mixFloat(vel.y);
+        mixFloat(body.GetAngularVelocity());
+        mix(body.IsAwake());
+    }
+    return hash;
+}
+
+physBroadPhase::Type physWorld::GetBroadPhaseType() const
+{
+    return m_broadPhaseType;
+}
+
 void physWorld::Simulate(float dt)
 {
-	for (unsigned int i = 0; i < m_bodies.count; ++i)
-	{
-		auto & curBody = m_bodies.bodies[i];
+    Step(dt);
+    if (m_trace)
+        m_trace->WriteStep(m_stepCount);
+    ++m_stepCount;
+}
 
-		InitializeBody(&curBody);
-        UpdateVelocity(&curBody, dt);
-        UpdatePosition(&curBody, dt);
-        //ClearBody(&curBody);
-	}
+bool physWorld::SetTraceFile(const std::string & path)
+{
+    m_trace.reset();
+    if (path.empty())
+        return true;
+    m_trace = std::make_unique<physTraceWriter>(path);
+    if (!m_trace->IsOpen())
+        m_trace.reset();
+    return m_trace != nullptr;
+}
+
+bool physWorld::IsTracing() const
+{
+    return m_trace != nullptr;
+}
 
-	GetCollisions()->Reset();
-	BroadPhase();
-    GetCollisions()->FilterCollisions();
-	NarrowPhase();
-	ResolveCollisions();
+void physWorld::Step(float dt)
+{
+    PHYS_PROFILE_ZONE(Step);
+    {
+        PHYS_PROFILE_ZONE(Integrate);
+        //  Static and sleeping bodies do not move. Slices start and end on awake bodies and
+        //  only take in short gaps of the others.
+        m_bodySlices.clear();
+        for (uint32_t c = 0; c < m_bodies.GetChunkCount(); ++c)
+        {
+            auto & state = *m_bodies.states[c];
+            if (state.awakeCount == 0)
+                continue;
+            uint32_t size = m_bodies.GetChunkSize(c);
+            for (uint32_t i = 0; i < size;)
+            {
+                if (!state.awake[i])
+                {
+                    ++i;
+                    continue;
+                }
+                uint32_t first = i;
+                uint32_t last = ++i;
+                for (uint32_t gap = 0; i < size && i - first < INTEGRATE_TASK_BODIES; ++i)
+                {
+                    if (state.awake[i])
+                    {
+                        last = i + 1;
+                        gap = 0;
+                    }
+                    else if (++gap > INTEGRATE_SLICE_GAP)
+                        break;
+                }
+                m_bodySlices.push_back({ c, first, last - first });
+                i = last;
+            }
+        }
+
+        //  Short runs are grouped, so a task still gets about INTEGRATE_TASK_BODIES bodies.
+        m_sliceTasks.clear();
+        m_sliceTasks.push_back(0);
+        uint32_t taskBodies = 0;
+        for (uint32_t s = 0; s < m_bodySlices.size(); ++s)
+        {
+            taskBodies += m_bodySlices[s].count;
+            if (taskBodies >= INTEGRATE_TASK_BODIES)
+            {
+                m_sliceTasks.push_back(s + 1);
+                taskBodies = 0;
+            }
+        }
+        if (m_sliceTasks.back() != m_bodySlices.size())
+            m_sliceTasks.push_back(uint32_t(m_bodySlices.size()));
+
+        //  Every body only writes its own state and world polygon.
+        ParallelFor(uint32_t(m_sliceTasks.size()) - 1, [&](uint32_t taskIdx)
+        {
+            for (uint32_t s = m_sliceTasks[taskIdx]; s < m_sliceTasks[taskIdx + 1]; ++s)
+            {
+                const BodySlice & slice = m_bodySlices[s];
+                Integrate(*m_bodies.states[slice.chunkIdx], slice.first, slice.count, dt);
+                RefreshTransforms(slice.chunkIdx, slice.first, slice.count);
+            }
+        });
+    }
 
-	for (unsigned int i = 0; i < m_bodies.count; ++i)
-	{
-		auto & curBody = m_bodies.bodies[i];
-		//UpdateVelocity(&curBody, dt);
-		//UpdatePosition(&curBody, dt);
-		ClearBody(&curBody);
-	}
+    {
+        PHYS_PROFILE_ZONE(ResetCollisions);
+        GetCollisions()->Reset();
+    }
+	BroadPhase(dt);
+    {
+        PHYS_PROFILE_ZONE(FilterCollisions);
+        GetCollisions()->FilterCollisions();
+        if (m_deterministic)
+            GetCollisions()->SortByBodyIds();
+    }
+    {
+        PHYS_PROFILE_ZONE(NarrowPhase);
+        NarrowPhase();
+    }
+    {
+        PHYS_PROFILE_ZONE(ResolveCollisions);
+        ResolveCollisions();
+    }
+    if (m_sleepingEnabled)
+    {
+        PHYS_PROFILE_ZONE(Islands);
+        UpdateSleep(dt);
+    }
+
+    for (uint32_t c = 0; c < m_bodies.GetChunkCount(); ++c)
+        ClearForces(*m_bodies.states[c], m_bodies.GetChunkSize(c));
 }
 
 physCollisionBuffer * physWorld::GetCollisions()
@@ -50,22 +244,18 @@ physCollisionBuffer * physWorld::GetCollisions()
 
 physBody * physWorld::RegisterPoly(float x, float y, physVec2 * vertices, unsigned int vertCount)
 {
-	if (m_bodies.count >= MAX_BODIES || m_curPolyIdx >= MAX_POLYGONS)
-		return nullptr;
-
-	physBody &curBody = m_bodies.bodies[m_bodies.count];
-	physPolyShape &curPoly = m_allPolys[m_curPolyIdx];
-
 	auto polyHandle = m_polyHandler.CreatePoly(vertices, vertCount);
 	if (polyHandle.GetCount() == 1)
 		return nullptr;
 
+	physPolyShape &curPoly = m_allPolys.Append();
 	curPoly = physPolyShape(polyHandle);
-	curBody.InitializePoly(&m_allPolys[m_curPolyIdx]);
-	curBody.SetPosition({ x, y });
 
-	++m_curPolyIdx;
-	++m_bodies.count;
+	physBody &curBody = m_bodies.Append();
+	curBody.m_id = m_bodies.GetCount() - 1;
+	curBody.InitializePoly(&curPoly, m_worldPolyHandler.CreatePoly(vertices, vertCount));
+	curBody.SetPosition({ x, y });
+	curBody.UpdateWorldPolygon();
 
 	return &curBody;
 }
@@ -91,35 +281,40 @@ physBody * physWorld::RegisterRectangle(float x, float y, float w, float h)
 
 physBody * physWorld::RegisterCircle(float x, float y, float r)
 {
-	if (m_bodies.count >= MAX_BODIES || m_curCircleIdx >= MAX_CIRCLES)
-		return nullptr;
-
-	physBody &curBody = m_bodies.bodies[m_bodies.count];
-	physCircleShape &curCircle = m_allCircles[m_curCircleIdx];
-
+	physCircleShape &curCircle = m_allCircles.Append();
 	curCircle = physCircleShape(r);
+
+	physBody &curBody = m_bodies.Append();
+	curBody.m_id = m_bodies.GetCount() - 1;
 	curBody.InitializeCircle(&curCircle);
 	curBody.SetPosition({ x, y });
 
-	++m_bodies.count;
-	++m_curCircleIdx;
-
 	return &curBody;
 }
 
-void physWorld::DestroyAll()
+void physWorld::Reserve(uint32_t circleCount, uint32_t polyCount, uint32_t vertexCount)
 {
-	for (uint32_t i = 0; i < m_curCircleIdx; ++i)
-		m_allCircles[i] = physCircleShape();
-	for (uint32_t i = 0; i < m_curPolyIdx; ++i)
-		m_allPolys[i] = physPolyShape();
+    m_bodies.Reserve(circleCount + polyCount);
+    m_allCircles.Reserve(circleCount);
+    m_allPolys.Reserve(polyCount);
+    m_polyHandler.Reserve(vertexCount);
+    m_worldPolyHandler.Reserve(vertexCount);
+    m_collisions.Reserve((circleCount + polyCount) * COLLISIONS_PER_BODY_RESERVE);
+}
 
-	m_curCircleIdx = 0;
-	m_curPolyIdx = 0;
+void physWorld::DestroyAll()
+{
+	m_allCircles.Clear();
+	m_allPolys.Clear();
 
-    m_bodies.ResetHard();
+    m_bodies.Reset();
     m_collisions.Reset();
+    m_collisions.ClearCache();
 	m_polyHandler.DestroyAll();
+	m_worldPolyHandler.DestroyAll();
+
+    //  Incremental broad phases would keep pairs of the destroyed bodies otherwise.
+    SetBroadPhase(m_broadPhaseType);
 }
 
 void physWorld::DestroyBody(physBody * body) const
@@ -127,93 +322,224 @@ void physWorld::DestroyBody(physBody * body) const
 	//	TODO
 }
 
-void physWorld::InitializeBody(physBody * body) const
-{
-	body->CalculateAABB();
-}
-
-void physWorld::ClearBody(physBody* body) const
+void physWorld::RefreshTransforms(uint32_t chunkIdx, uint32_t first, uint32_t count)
 {
-	body->Refresh();
+    auto & state = *m_bodies.states[chunkIdx];
+    uint32_t chunkFirst = chunkIdx << BODY_CHUNK_SHIFT;
+
+    //  Static and sleeping bodies in gaps of the slice keep the box they had when they stopped
+    //  moving. It is saved around the circle sweep, in raw storage so the rest is not zeroed.
+    alignas(physAABB) unsigned char keptStorage[INTEGRATE_TASK_BODIES * sizeof(physAABB)];
+    auto kept = reinterpret_cast<physAABB*>(keptStorage);
+    for (uint32_t i = first; i < first + count; ++i)
+        if (!state.awake[i])
+            kept[i - first] = state.aabb[i];
+
+    //  Circles are position -+ radius for the whole slice, polygons are then overwritten from
+    //  their world vertices, which every later stage of the step reads as well.
+    ComputeCircleAABBs(state.aabb + first, state.position + first, state.circleRadius + first, count);
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        if (!state.awake[i])
+        {
+            state.aabb[i] = kept[i - first];
+            continue;
+        }
+        if (state.circleRadius[i] != 0.f)
+            continue;
+        auto & body = m_bodies.bodies[chunkFirst + i];
+        body.UpdateWorldPolygon();
+        body.CalculateAABB();
+    }
 }
 
-void physWorld::UpdateVelocity(physBody * body, float dt) const
+void physWorld::Integrate(physBodyStateChunk & state, uint32_t first, uint32_t count, float dt) const
 {
-	if (body == nullptr) return;
-	if (body->IsStatic()) return;
+    //  Static bodies have no velocity, force or gravity, so they stay in place.
+    float halfDt = dt * 0.5f;
+    IntegrateVelocities(state.linearVel + first, state.angularVel + first, state.force + first, state.torque + first,
+                        state.invMass + first, state.invI + first, state.gravityScale + first, m_gravity, halfDt, count);
+    IntegratePositions(state.position + first, state.linearVel + first, dt, count);
+
+    //  Trigonometry does not vectorize, so rotation gets its own pass. Bodies that do not spin,
+    //  static ones included, skip it.
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        float angle = state.angularVel[i] * dt;
+        if (angle != 0.f)
+            state.rotation[i].rotateBy(angle);
+    }
 
-	body->m_linearVel += (body->m_force * body->m_invMass + m_gravity) * dt *0.5f;
-	body->m_angularVel += body->m_torque * body->m_invI * dt *0.5f;
+    IntegrateVelocities(state.linearVel + first, state.angularVel + first, state.force + first, state.torque + first,
+                        state.invMass + first, state.invI + first, state.gravityScale + first, m_gravity, halfDt, count);
 }
 
-void physWorld::UpdatePosition(physBody * body, float dt) const
+void physWorld::ClearForces(physBodyStateChunk & state, uint32_t count) const
 {
-	if (body == nullptr) return;
-	if (body->IsStatic()) return;
-
-	body->m_position += body->m_linearVel * dt;
-	body->m_rotation.rotateBy(body->m_angularVel * dt);
-	UpdateVelocity(body, dt);
+    std::fill(state.force, state.force + count, physVec2());
+    std::fill(state.torque, state.torque + count, 0.f);
 }
 
-void physWorld::BroadPhase()
+void physWorld::BroadPhase(float dt)
 {
-    Benchmark::Get().RunTimer("Collision");
+    PHYS_PROFILE_ZONE(BroadPhase);
     auto bodySpan = m_bodies.AsSpan();
-#if BP == BP_NAIVE
-    NaiveNbyN(bodySpan, m_collisions);
-#elif (BP & BP_UNIFORM) != 0
-    UniformGrid(bodySpan, m_collisions);
-#elif BP == BP_HIERARCHICAL_GRID
-    HierarchicalGrid(bodySpan, m_collisions);
-#elif BP == BP_QUADTREE
-    QuadTree(bodySpan, m_collisions);
-#endif
-    Benchmark::Get().StopTimer("Collision");
+    m_broadPhase->SetTimeStep(dt);
+    m_broadPhase->SetBodies(bodySpan);
+    m_broadPhase->Solve(m_collisions);
 }
 
 void physWorld::NarrowPhase()
 {
-    if (m_collisions.filteredCount == 0)
-        return;
-    for (uint32_t i = 0; i < MAX_COLLISIONS; ++i)
+    //  Bucketed by shape types first, so each test runs over a batch of its own pairs
+    //  without branching per pair.
+    auto & collisions = m_collisions.filteredCollisions;
+    for (auto & batch : m_pairBatches)
+        batch.clear();
+    for (uint32_t i = 0; i < collisions.size(); ++i)
     {
-        auto &col = m_collisions.filteredCollisions[i];
-        if (!col.IsValid())
+        auto & col = collisions[i];
+        if (col.IsAsleep())
+        {
+            //  Keeps the cached contacts alive, they link the island and warm start it on waking.
+            col.cache = m_collisions.contactCache.Acquire(col);
             continue;
-        auto b1 = col.A;
-		auto b2 = col.B;
-		auto b1type = b1->GetShape()->GetType();
-		auto b2type = b2->GetShape()->GetType();
-
-		if (b1type == physShape::Type::sCircle)
-		{
-			if (b2type == physShape::Type::sCircle)
-			{
-				CircleToCircle(&col, b1, b2);
-			}
-			else if (b2type == physShape::Type::sPoly)
-			{
-				CircleToPoly(&col, b1, b2);
-			}
-		}
-		else if (b1type == physShape::Type::sPoly)
-		{
-			if (b2type == physShape::Type::sCircle)
-			{
-				PolyToCircle(&col, b1, b2);
-
-			}
-			else if (b2type == physShape::Type::sPoly)
-			{
-				PolyToPoly(&col, b1, b2);
-
-			}
-		}
-	}
+        }
+        m_pairBatches[col.A->GetShapeType() * physShape::sCount + col.B->GetShapeType()].push_back(i);
+    }
+
+    //  Polygon pairs keep their last separating axis in the cache entry.
+    for (auto idx : m_pairBatches[physShape::sPoly * physShape::sCount + physShape::sPoly])
+        collisions[idx].cache = m_collisions.contactCache.Acquire(collisions[idx]);
+
+    if (m_threadPool == nullptr)
+    {
+        for (uint32_t a = 0; a < physShape::sCount; ++a)
+            for (uint32_t b = 0; b < physShape::sCount; ++b)
+            {
+                auto collide = COLLIDE_FUNCTIONS[a][b];
+                for (auto idx : m_pairBatches[a * physShape::sCount + b])
+                {
+                    auto & col = collisions[idx];
+                    collide(&col, col.A, col.B);
+                }
+            }
+        return;
+    }
+    NarrowPhaseParallel();
+}
+
+void physWorld::NarrowPhaseParallel()
+{
+    //  Batches laid end to end keep the pairs of a type together. Tasks are cut at equal
+    //  estimated cost rather than pair count, so a task of polygon pairs holds far fewer
+    //  pairs than one of circles and no thread is left with all the expensive ones.
+    auto & collisions = m_collisions.filteredCollisions;
+    m_narrowPairs.clear();
+    for (auto & batch : m_pairBatches)
+        m_narrowPairs.insert(m_narrowPairs.end(), batch.begin(), batch.end());
+
+    uint32_t pairCount = uint32_t(m_narrowPairs.size());
+    uint64_t totalCost = 0;
+    m_narrowCosts.resize(pairCount);
+    for (uint32_t i = 0; i < pairCount; ++i)
+    {
+        auto & col = collisions[m_narrowPairs[i]];
+        m_narrowCosts[i] = EstimateCollideCost(col.A, col.B);
+        totalCost += m_narrowCosts[i];
+    }
+
+    uint64_t taskCost = std::max<uint64_t>(NARROW_PHASE_TASK_COST, totalCost / (GetThreadCount() * NARROW_PHASE_TASKS_PER_THREAD));
+    m_narrowTasks.clear();
+    m_narrowTasks.push_back(0);
+    uint64_t cost = 0;
+    for (uint32_t i = 0; i < pairCount; ++i)
+    {
+        cost += m_narrowCosts[i];
+        if (cost >= taskCost)
+        {
+            m_narrowTasks.push_back(i + 1);
+            cost = 0;
+        }
+    }
+    if (m_narrowTasks.back() != pairCount)
+        m_narrowTasks.push_back(pairCount);
+
+    //  A test only writes its own pair, and its cache entry for polygons. Manifolds stay in
+    //  the filtered order whichever thread computes them.
+    m_threadPool->ParallelFor(uint32_t(m_narrowTasks.size()) - 1, [&](uint32_t taskIdx, uint32_t)
+    {
+        for (uint32_t i = m_narrowTasks[taskIdx]; i < m_narrowTasks[taskIdx + 1]; ++i)
+        {
+            auto & col = collisions[m_narrowPairs[i]];
+            COLLIDE_FUNCTIONS[col.A->GetShapeType()][col.B->GetShapeType()](&col, col.A, col.B);
+        }
+    });
 }
 
 void physWorld::ResolveCollisions()
 {
     m_collisions.ResolveAll();
 }
+
+void physWorld::UpdateSleep(float dt)
+{
+    //  The solver linked the touching pairs of this step, the sleeping ones are added here. They
+    //  were skipped, but their cache still holds the contacts they fell asleep with. The solver
+    //  cleared it for awake pairs that do not touch.
+    uint32_t bodyCount = m_bodies.GetCount();
+    physIslandSet & islands = m_collisions.solver.GetIslands();
+    islands.Grow(bodyCount);
+    for (auto & col : m_collisions.filteredCollisions)
+    {
+        bool sleeping = col.contactCnt == 0 && col.cache && col.cache->contactCnt > 0;
+        if (sleeping && !col.A->IsStatic() && !col.B->IsStatic())
+            islands.Link(col.A->GetId(), col.B->GetId());
+    }
+
+    //  A sleeping body in an island with an awake one was touched, it counts as not resting.
+    m_islandSleepTime.assign(bodyCount, FLT_MAX);
+    m_islandAwake.assign(bodyCount, 0);
+    for (uint32_t i = 0; i < bodyCount; ++i)
+    {
+        auto & body = m_bodies.bodies[i];
+        if (body.m_static)
+            continue;
+        if (!body.m_sleeping)
+        {
+            bool resting = body.GetLinearVelocity().lengthSquared() <= SLEEP_LINEAR_VELOCITY * SLEEP_LINEAR_VELOCITY &&
+                           fabsf(body.GetAngularVelocity()) <= SLEEP_ANGULAR_VELOCITY;
+            body.m_sleepTime = resting ? body.m_sleepTime + dt : 0.f;
+        }
+        uint32_t root = islands.Find(i);
+        m_islandAwake[root] |= uint8_t(!body.m_sleeping);
+        m_islandSleepTime[root] = std::min(m_islandSleepTime[root], body.m_sleeping ? 0.f : body.m_sleepTime);
+    }
+
+    uint32_t awakeCount = 0;
+    for (uint32_t i = 0; i < bodyCount; ++i)
+    {
+        auto & body = m_bodies.bodies[i];
+        if (body.m_static)
+            continue;
+        uint32_t root = islands.Find(i);
+        if (m_islandAwake[root])
+            body.SetAwake(m_islandSleepTime[root] < SLEEP_TIME);
+        awakeCount += body.IsAwake();
+    }
+    PHYS_PROFILE_VALUE(AwakeBodies, awakeCount);
+}
+
+void physWorld::SetSleepingEnabled(bool flag)
+{
+    m_sleepingEnabled = flag;
+    m_collisions.solver.SetTrackIslands(flag);
+    if (!flag)
+        for (uint32_t i = 0; i < m_bodies.GetCount(); ++i)
+            m_bodies.bodies[i].SetAwake();
+}
+
+bool physWorld::IsSleepingEnabled() const
+{
+    return m_sleepingEnabled;
+}
@@ -3,16 +3,58 @@
 #include "PhysicsBody.h"
 #include "PhysicsCollision.h"
 #include "PhysicsSettings.h"
+#include "PhysicsBroadPhase.h"
+#include "PhysicsTrace.h"
+#include "PhysicsIsland.h"
 
 class physWorld
 {
 public:
-	physWorld();
+	explicit physWorld(physBroadPhase::Type broadPhase = physBroadPhase::bpQuadTree);
 
 	void SetGravity(const physVec2& gravity);
 
+    //  Replaces the broad phase, it rebuilds its state from the bodies on the next step.
+    //  Returns false and keeps the current one for an unknown type.
+    bool SetBroadPhase(physBroadPhase::Type type);
+    physBroadPhase::Type GetBroadPhaseType() const;
+
+    //  Threads used by every stage of the step, the calling thread included. 1 runs them
+    //  serially. With pinThreads, workers are pinned to consecutive cores from firstCore on.
+    void SetThreadCount(uint32_t threadCount, bool pinThreads = false, uint32_t firstCore = 0);
+    uint32_t GetThreadCount() const;
+    //  Runs on a pool owned by the caller instead, which must outlive its use by the world.
+    //  nullptr runs serially.
+    void SetThreadPool(physThreadPool * threadPool);
+
+    //  Velocity iterations refine contact impulses, position iterations push overlapping
+    //  bodies apart. Defaults are SOLVER_ITERATIONS and SOLVER_POSITION_ITERATIONS.
+    void SetSolverIterations(uint32_t velocityIterations, uint32_t positionIterations);
+    uint32_t GetVelocityIterations() const;
+    uint32_t GetPositionIterations() const;
+
+    //  Makes a step depend only on the world state: pairs are ordered by body ids and the solver
+    //  splits its work the same way for any thread count. Two runs from the same state then
+    //  match bit for bit for any thread count, and across broad phases that find the same pairs.
+    //  Off by default, sorting the pairs costs time.
+    void SetDeterministic(bool flag);
+    bool IsDeterministic() const;
+
+    //  Hash of the position, rotation, velocities and sleep state of every body, in id order.
+    //  Equal hashes after every step show two runs are identical.
+    uint64_t ComputeStateHash() const;
+
 	void Simulate(float dt = DT);
 
+    //  Lets islands at rest fall asleep, on by default. Disabling wakes every body.
+    void SetSleepingEnabled(bool flag);
+    bool IsSleepingEnabled() const;
+
+    //  Writes the profiler zones of every following step to a Chrome trace file. An empty
+    //  path closes the current trace. Returns false if the file could not be opened.
+    bool SetTraceFile(const std::string & path);
+    bool IsTracing() const;
+
 	physCollisionBuffer *GetCollisions();
 
 	physBody* RegisterPoly(float x, float y, physVec2 *vertices, unsigned int vertCount);
@@ -20,27 +62,79 @@ public:
 	physBody* RegisterRectangle(float x, float y, float w, float h);
 	physBody* RegisterCircle(float x, float y, float r);
 
+    //  Preallocates storage so registering this many shapes does not allocate.
+    void Reserve(uint32_t circleCount, uint32_t polyCount, uint32_t vertexCount);
+
 	void DestroyAll();
 	void DestroyBody(physBody *body) const;
 
 private:	
-	void InitializeBody(physBody *body) const;
-	void ClearBody(physBody *body) const;
-	void UpdateVelocity(physBody *body, float dt) const;
-	void UpdatePosition(physBody *body, float dt) const;
+    void Step(float dt);
+
+    //  Runs fn(taskIdx) for every task, on the pool if there is one.
+    template<typename Fn>
+    void ParallelFor(uint32_t taskCount, Fn && fn)
+    {
+        if (m_threadPool == nullptr)
+        {
+            for (uint32_t i = 0; i < taskCount; ++i)
+                fn(i);
+            return;
+        }
+        m_threadPool->ParallelFor(taskCount, [&](uint32_t taskIdx, uint32_t) { fn(taskIdx); });
+    }
 
-	void BroadPhase();
+    //  Sweeps over the bodies [first, first + count) of one storage chunk.
+    void RefreshTransforms(uint32_t chunkIdx, uint32_t first, uint32_t count);
+    void Integrate(physBodyStateChunk & state, uint32_t first, uint32_t count, float dt) const;
+    void ClearForces(physBodyStateChunk & state, uint32_t count) const;
+
+	void BroadPhase(float dt);
 	void NarrowPhase();
+    void NarrowPhaseParallel();
 	void ResolveCollisions();
+    void UpdateSleep(float dt);
 
 	physVec2 m_gravity;
 
     physBodyBuffer m_bodies;
-	unsigned int m_curCircleIdx;
-	physCircleShape m_allCircles[MAX_CIRCLES];
-	unsigned int m_curPolyIdx;
-	physPolyShape m_allPolys[MAX_POLYGONS];
+    physChunkedArray<physCircleShape, 10> m_allCircles;
+    physChunkedArray<physPolyShape, 10> m_allPolys;
 	physCollisionBuffer m_collisions;
+    //  Indices into the filtered pairs for every combination of shape types.
+    std::vector<uint32_t> m_pairBatches[physShape::sCount * physShape::sCount];
+    //  Parallel narrow phase: the batches end to end, estimated cost of each of their pairs,
+    //  and the first pair of every task followed by the pair count.
+    std::vector<uint32_t> m_narrowPairs;
+    std::vector<uint32_t> m_narrowCosts;
+    std::vector<uint32_t> m_narrowTasks;
+
+    bool m_deterministic = false;
+    bool m_sleepingEnabled = true;
+    //  Per island root: shortest sleep time of its bodies and whether any of them is awake.
+    std::vector<float> m_islandSleepTime;
+    std::vector<uint8_t> m_islandAwake;
+
+    std::unique_ptr<physBroadPhase> m_broadPhase;
+    physBroadPhase::Type m_broadPhaseType;
+    std::unique_ptr<physThreadPool> m_ownedThreadPool;
+    physThreadPool *m_threadPool = nullptr;
+
+    //  Awake bodies of one chunk, with short gaps of others. A task integrates the slices from
+    //  its entry of m_sliceTasks up to the next one.
+    struct BodySlice
+    {
+        uint32_t chunkIdx;
+        uint32_t first;
+        uint32_t count;
+    };
+    std::vector<BodySlice> m_bodySlices;
+    std::vector<uint32_t> m_sliceTasks;
+
+    std::unique_ptr<physTraceWriter> m_trace;
+    uint64_t m_stepCount = 0;
 
 	physPolyHandler m_polyHandler;
+	//	World-space copies of the polygons, in body order.
+	physPolyHandler m_worldPolyHandler;
 };
@@ -0,0 +1,174 @@
+#include "Scenes.h"
+
+static void InitScene1(physWorld & world, std::vector<physBody*> & bodies, int bodyCount, SceneRandom & randf)
+{
+    world.SetGravity({ 0, 0 });
+
+    auto createWall = [&](int x, int y, int w, int h)
+    {
+        auto wall = world.RegisterRectangle(x, y, w, h);
+        wall->SetStatic();
+        bodies.push_back(wall);
+    };
+
+    createWall(400, 0, 800, 20);
+    createWall(400, 800, 800, 20);
+    createWall(0, 400, 20, 780);
+    createWall(800, 400, 20, 780);
+
+    for (int i = 0; i < bodyCount - 4; ++i)
+    {
+        bodies.push_back(world.RegisterCircle(randf(790, 10), randf(790, 10), randf(8, 5)));
+        auto impulse = physVec2(1000.f, 1000.f);
+        impulse.rotate(physRot(randf(360)));
+        bodies.back()->ApplyImpulse(impulse);
+    }
+}
+
+static void InitScene2(physWorld & world, std::vector<physBody*> & bodies, int bodyCount, SceneRandom & randf)
+{
+    world.SetGravity({ 0, 0 });
+
+    auto createWall = [&](int x, int y, int w, int h)
+    {
+        auto wall = world.RegisterRectangle(x, y, w, h);
+        wall->SetStatic();
+        bodies.push_back(wall);
+    };
+
+    createWall(400, 0, 800, 20);
+    createWall(400, 800, 800, 20);
+    createWall(0, 400, 20, 780);
+    createWall(800, 400, 20, 780);
+
+    auto maxBodiesSqrt = int(sqrtf(float(bodyCount))) + 1;
+    auto bodySize = int(800 / maxBodiesSqrt) / 2;
+
+    for (int i = 0; i < bodyCount - 4; ++i)
+    {
+        bodies.push_back(world.RegisterCircle(randf(800 - bodySize, bodySize), randf(800 - bodySize, bodySize), bodySize));
+        auto impulse = physVec2(bodySize * 1000.f, bodySize * 1000.f);
+        impulse.rotate(physRot(randf(360)));
+        bodies.back()->ApplyImpulse(impulse);
+    }
+}
+
+static void InitScene3(physWorld & world, std::vector<physBody*> & bodies, int bodyCount, SceneRandom & randf)
+{
+    world.SetGravity({ 0, 0 });
+
+    auto createWall = [&](int x, int y, int w, int h)
+    {
+        auto wall = world.RegisterRectangle(x, y, w, h);
+        wall->SetStatic();
+        bodies.push_back(wall);
+    };
+
+    createWall(400, 0, 800, 20);
+    createWall(400, 800, 800, 20);
+    createWall(0, 400, 20, 780);
+    createWall(800, 400, 20, 780);
+
+    for (int i = 0; i < bodyCount - 4; ++i)
+    {
+        auto size = randf(40, 5);
+        bodies.push_back(world.RegisterCircle(randf(800 - size, size), randf(800-size, size), size));
+        auto impulse = physVec2(size * 1000.f, size * 1000.f);
+        impulse.rotate(physRot(randf(360)));
+        bodies.back()->ApplyImpulse(impulse);
+    }
+
+}
+
+static void InitScene4(physWorld & world, std::vector<physBody*> & bodies, int /*bodyCount*/, SceneRandom & /*randf*/)
+{
+    world.SetGravity({ 0.f, 10.f });
+
+    auto floor1 = world.RegisterRectangle(200, 200, 200, 30);
+    floor1->SetStatic();
+    floor1->SetRotation(static_cast<float>(M_PI_4) / 2);
+    bodies.push_back(floor1);
+    auto floor2 = world.RegisterRectangle(400, 300, 200, 30);
+    floor2->SetStatic();
+    floor2->SetStaticFriction(0.9f);
+    floor2->SetDynamicFriction(0.6f);
+    floor2->SetRotation(-static_cast<float>(M_PI_4) / 2);
+    bodies.push_back(floor2);
+    auto floor3 = world.RegisterRectangle(200, 400, 200, 30);
+    floor3->SetStatic();
+    floor3->SetRotation(static_cast<float>(M_PI_4) / 2);
+    bodies.push_back(floor3);
+    auto circle = world.RegisterCircle(130, 10, 20);
+    circle->SetRestitution(0.5f);
+    bodies.push_back(circle);
+    auto box = world.RegisterBox(130, 70, 30);
+    box->SetRestitution(0.1f);
+    box->SetStaticFriction(0.2f);
+    box->SetDynamicFriction(0.1f);
+    bodies.push_back(box);
+}
+
+static void InitScene5(physWorld & world, std::vector<physBody*> & bodies, int bodyCount, SceneRandom & randf)
+{
+    world.SetGravity({ 0, 10 });
+
+    physVec2 v[5] = { { -50, -50 },{ 50, -50 },{ 100, 0 },{ 50, 50 },{ -50, 50 } };
+    auto bullet = world.RegisterPoly(-100, 300, v, 5);
+    bodies.push_back(bullet);
+
+    for (int i = 0; i < bodyCount - 2; ++i)
+    {
+        //bodies.push_back(world.RegisterCircle(randf(800), randf(400, 200), randf(40, 10)));
+        bodies.push_back(world.RegisterBox(randf(800), randf(400, 200), randf(40, 10)));
+    }
+
+    bullet->ApplyImpulse({ 5000000, 0 });
+    bullet->SetDensity(100.f);
+}
+
+static void InitScene6(physWorld & world, std::vector<physBody*> & bodies, int /*bodyCount*/, SceneRandom & /*randf*/)
+{
+    world.SetGravity({ 0, 10 });
+
+    auto floor = world.RegisterRectangle(400, 300, 100, 100);
+    floor->SetStatic();
+    bodies.push_back(floor);
+    bodies.push_back(world.RegisterBox(400, 200, 30));
+
+}
+
+static void InitScene7(physWorld & world, std::vector<physBody*> & bodies, int /*bodyCount*/, SceneRandom & /*randf*/)
+{
+    world.SetGravity({ 0, 10 });
+
+    auto floor = world.RegisterRectangle(400, 600, 1000, 100);
+    floor->SetStatic();
+    bodies.push_back(floor);
+
+    for (int i = 0; i < 5; ++i)
+    {
+        for (int j = 5 - i; j > 0; --j)
+        {
+            bodies.push_back(world.RegisterBox(100.f + (i * 16.f) + (j * 32.f), 530.f - (i * 32.f), 30.f));
+            bodies.back()->SetStaticFriction(0.7f);
+            bodies.back()->SetDynamicFriction(0.4f);
+        }
+    }
+
+}
+
+void InitScene(int sceneIdx, physWorld & world, std::vector<physBody*> & bodies, int bodyCount, uint32_t seed)
+{
+    SceneRandom randf(seed);
+    switch (sceneIdx)
+    {
+    case 1: InitScene1(world, bodies, bodyCount, randf); break;
+    case 2: InitScene2(world, bodies, bodyCount, randf); break;
+    case 3: InitScene3(world, bodies, bodyCount, randf); break;
+    case 4: InitScene4(world, bodies, bodyCount, randf); break;
+    case 5: InitScene5(world, bodies, bodyCount, randf); break;
+    case 6: InitScene6(world, bodies, bodyCount, randf); break;
+    case 7: InitScene7(world, bodies, bodyCount, randf); break;
+    default: break;
+    }
+}
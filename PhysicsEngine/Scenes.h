@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include "PhysicsWorld.h"
+
+//  Scene setups shared by the demo and the headless benchmark. They do not depend on SFML.
+
+constexpr int SCENE_COUNT = 7;
+constexpr uint32_t DEFAULT_SCENE_SEED = 1;
+
+class SceneRandom
+{
+public:
+    explicit SceneRandom(uint32_t seed) : m_rng(seed) {}
+
+    //  Uniform float from [lb, rb).
+    float operator()(int rb, int lb = 0)
+    {
+        float random = m_urd(m_rng);
+        float diff = float(rb - lb);
+        return random * diff + lb;
+    }
+
+private:
+    std::mt19937_64 m_rng;
+    std::uniform_real_distribution<float> m_urd;
+};
+
+//  Builds scene sceneIdx (1 - SCENE_COUNT) into an empty world and appends its bodies.
+//  Random placement is seeded on every call, so a scene always starts from the same state.
+void InitScene(int sceneIdx, physWorld & world, std::vector<physBody*> & bodies, int bodyCount, uint32_t seed = DEFAULT_SCENE_SEED);
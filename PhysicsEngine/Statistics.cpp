@@ -0,0 +1,131 @@
+#include "Statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iterator>
+#include <string>
+
+constexpr BenchZone StepStatistics::ZONES[];
+
+void Histogram::Reset()
+{
+    std::fill(std::begin(m_buckets), std::end(m_buckets), 0u);
+    m_count = 0;
+    m_sum = 0;
+    m_min = UINT64_MAX;
+    m_max = 0;
+}
+
+uint64_t Histogram::GetPercentile(double fraction) const
+{
+    if (m_count == 0)
+        return 0;
+    auto target = uint64_t(std::ceil(fraction * m_count));
+    target = std::max<uint64_t>(target, 1);
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen >= target)
+            return std::min(GetBucketHigh(i), m_max);
+    }
+    return m_max;
+}
+
+uint64_t Histogram::GetBucketLow(uint32_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    uint32_t shift = bucket / SUB_BUCKETS - 1;
+    return uint64_t(bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+}
+
+uint64_t Histogram::GetBucketHigh(uint32_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    uint32_t shift = bucket / SUB_BUCKETS - 1;
+    return GetBucketLow(bucket) + ((uint64_t(1) << shift) - 1);
+}
+
+void Histogram::PrintBuckets(std::ostream & out, double scale) const
+{
+    for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        if (!m_buckets[i])
+            continue;
+        out << "    " << GetBucketLow(i) * scale << " - " << GetBucketHigh(i) * scale << ": " << m_buckets[i] << "\n";
+    }
+}
+
+void StepStatistics::Sample()
+{
+    auto & benchmark = Benchmark::Get();
+    for (uint32_t i = 0; i < ZONE_COUNT; ++i)
+        m_zones[i].Add(benchmark.PopResult(ZONES[i]).count);
+    m_pairs.Add(benchmark.PopValue(BenchValue::UniqueCollisions));
+    m_tests.Add(benchmark.PopValue(BenchValue::TestCount));
+
+    if (!benchmark.HasCounters())
+        return;
+    m_hasCounters = true;
+    for (uint32_t i = 0; i < ZONE_COUNT; ++i)
+        m_counters[i] += benchmark.PopCounters(ZONES[i]);
+}
+
+void StepStatistics::Reset()
+{
+    for (auto & zone : m_zones)
+        zone.Reset();
+    m_pairs.Reset();
+    m_tests.Reset();
+    for (auto & counters : m_counters)
+        counters = PerfSample();
+    m_hasCounters = false;
+}
+
+void StepStatistics::Print(std::ostream & out, bool buckets) const
+{
+    auto oldFlags = out.flags();
+    auto oldPrecision = out.precision();
+    auto printRow = [&](const char* name, const Histogram & histogram, double scale, int precision)
+    {
+        out << std::fixed << std::setprecision(precision) << std::left << std::setw(24) << name << std::right
+            << std::setw(10) << histogram.GetMean() * scale
+            << std::setw(10) << histogram.GetPercentile(0.5) * scale
+            << std::setw(10) << histogram.GetPercentile(0.9) * scale
+            << std::setw(10) << histogram.GetPercentile(0.99) * scale
+            << std::setw(10) << histogram.GetMax() * scale << "\n";
+        if (buckets)
+            histogram.PrintBuckets(out, scale);
+    };
+
+    out << "Steps: " << m_zones[0].GetCount() << "\n";
+    out << std::left << std::setw(24) << "" << std::right
+        << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+        << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+    for (uint32_t i = 0; i < ZONE_COUNT; ++i)
+        printRow((std::string(Benchmark::GetName(ZONES[i])) + " ms").c_str(), m_zones[i], 1e-6, 3);
+    printRow("Pairs", m_pairs, 1.0, 0);
+    printRow("Tests", m_tests, 1.0, 0);
+
+    if (m_hasCounters)
+    {
+        out << std::setprecision(2) << std::left << std::setw(24) << "" << std::right
+            << std::setw(10) << "IPC" << std::setw(10) << "L1D/ki" << std::setw(10) << "LLC/ki"
+            << std::setw(10) << "Branch/ki" << "\n";
+        for (uint32_t i = 0; i < ZONE_COUNT; ++i)
+        {
+            auto & counters = m_counters[i];
+            out << std::left << std::setw(24) << Benchmark::GetName(ZONES[i]) << std::right
+                << std::setw(10) << counters.GetIPC()
+                << std::setw(10) << counters.GetPerKiloInstruction(PerfEvent::L1DMisses)
+                << std::setw(10) << counters.GetPerKiloInstruction(PerfEvent::LLCMisses)
+                << std::setw(10) << counters.GetPerKiloInstruction(PerfEvent::BranchMisses) << "\n";
+        }
+    }
+    out.flags(oldFlags);
+    out.precision(oldPrecision);
+}
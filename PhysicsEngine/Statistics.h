@@ -1,33 +1,106 @@
 #pragma once
-#include <vector>
-#include <numeric>
+#include <cstdint>
+#include <ostream>
 
-class MovingAverage
+#include "Benchmark.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//  Histogram of non-negative integer samples with log-linear buckets. Values below SUB_BUCKETS
+//  get a bucket each, every higher power of two is split into SUB_BUCKETS equal buckets, so a
+//  percentile is off by less than 1 / SUB_BUCKETS of its value. Adding a sample is a few integer
+//  operations and the memory is fixed, so it can stay enabled in release builds.
+
+class Histogram
 {
 public:
-    MovingAverage(uint16_t bufferSize)
+    static constexpr uint32_t SUB_BUCKET_BITS = 4;
+    static constexpr uint32_t SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static constexpr uint32_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    Histogram() { Reset(); }
+
+    void Add(uint64_t value)
     {
-        m_buffer.resize(bufferSize);
-        m_init = true;
-        m_index = 0;
+        ++m_buckets[GetBucket(value)];
+        m_min = value < m_min ? value : m_min;
+        m_max = value > m_max ? value : m_max;
+        m_sum += value;
+        ++m_count;
     }
-    double Get(double nextValue)
+
+    void Reset();
+
+    uint64_t GetCount() const { return m_count; }
+    uint64_t GetMin() const { return m_count ? m_min : 0; }
+    uint64_t GetMax() const { return m_max; }
+    double GetMean() const { return m_count ? double(m_sum) / m_count : 0.0; }
+
+    //  Value that the given fraction of samples does not exceed, e.g. 0.99 for p99.
+    uint64_t GetPercentile(double fraction) const;
+
+    //  Prints the non-empty buckets as "low - high: count", values multiplied by scale.
+    void PrintBuckets(std::ostream & out, double scale = 1.0) const;
+
+    static uint32_t GetBucket(uint64_t value)
     {
-        if (!m_init)
-        {
-            m_buffer[m_index] = nextValue;
-            m_index = (m_index + 1) % m_buffer.size();
-        }
-        else
-        {
-            m_buffer.assign(m_buffer.size(), nextValue);
-            m_init = false;
-        }
-        
-        return accumulate(m_buffer.begin(), m_buffer.end(), 0.0) / m_buffer.size();
+        if (value < SUB_BUCKETS)
+            return uint32_t(value);
+        uint32_t shift = HighestBit(value) - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + uint32_t(value >> shift) - SUB_BUCKETS;
     }
+    static uint64_t GetBucketLow(uint32_t bucket);
+    static uint64_t GetBucketHigh(uint32_t bucket);
+
+private:
+    static uint32_t HighestBit(uint64_t value)
+    {
+#if defined(_MSC_VER)
+        unsigned long idx;
+        _BitScanReverse64(&idx, value);
+        return idx;
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    uint32_t m_buckets[BUCKET_COUNT];
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+//  Per-step distributions fed from the Benchmark counters: step and phase times in nanoseconds,
+//  unique pairs and broad phase tests. When hardware counters are enabled their per-phase sums
+//  are kept as well. Call Sample once after every step.
+
+class StepStatistics
+{
+public:
+    static constexpr BenchZone ZONES[] = { BenchZone::Step, BenchZone::Integrate, BenchZone::BroadPhase,
+                                           BenchZone::FilterCollisions, BenchZone::NarrowPhase, BenchZone::ResolveCollisions,
+                                           BenchZone::Islands };
+    static constexpr uint32_t ZONE_COUNT = sizeof(ZONES) / sizeof(ZONES[0]);
+
+    void Sample();
+    void Reset();
+
+    //  Prints count, mean, p50, p90, p99 and max of every distribution, with the buckets if asked,
+    //  followed by IPC and misses per thousand instructions of every phase if counters were read.
+    void Print(std::ostream & out, bool buckets = false) const;
+
+    const Histogram & GetZone(uint32_t zoneIdx) const { return m_zones[zoneIdx]; }
+    const Histogram & GetPairs() const { return m_pairs; }
+    const Histogram & GetTests() const { return m_tests; }
+    const PerfSample & GetCounters(uint32_t zoneIdx) const { return m_counters[zoneIdx]; }
+
 private:
-    bool m_init;
-    unsigned m_index;
-    std::vector<double> m_buffer;
-};
\ No newline at end of file
+    Histogram m_zones[ZONE_COUNT];
+    Histogram m_pairs;
+    Histogram m_tests;
+    PerfSample m_counters[ZONE_COUNT];
+    bool m_hasCounters = false;
+};